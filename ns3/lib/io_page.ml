@@ -22,7 +22,9 @@ let page_size = 1 lsl 12
 
 let length t = Array1.dim t
 
-let get n = Array1.create char c_layout (n * page_size)
+external alloc_pages: int -> t = "caml_alloc_pages"
+
+let get n = alloc_pages n
 
 let get_order order = get (1 lsl order)
 
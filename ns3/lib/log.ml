@@ -0,0 +1,78 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+open Printf
+
+type level = Debug | Info | Warn | Error
+
+external ns3_log_open : string -> int -> unit = "ocaml_ns3_log_open"
+external ns3_log_append : level -> int -> string -> unit = "ocaml_ns3_log_append"
+external ns3_log_flush : unit -> unit = "ocaml_ns3_log_flush"
+external ns3_log_close : unit -> unit = "ocaml_ns3_log_close"
+
+let node_handle = Lwt.new_key ()
+
+let current_node () =
+  match Lwt.get node_handle with
+  | Some h -> h
+  | None -> -1
+
+let threshold = ref Info
+let node_thresholds : (int, level) Hashtbl.t = Hashtbl.create 16
+
+let set_level l = threshold := l
+
+let set_node_level node = function
+  | Some l -> Hashtbl.replace node_thresholds node l
+  | None -> Hashtbl.remove node_thresholds node
+
+let to_file = ref false
+
+let open_file ?(ring_size=16 * 1024 * 1024) path =
+  if ring_size < 4096 then invalid_arg "Log.open_file: ring_size";
+  ns3_log_open path ring_size;
+  to_file := true
+
+let flush () = if !to_file then ns3_log_flush ()
+
+let close () =
+  if !to_file then begin
+    to_file := false;
+    ns3_log_close ()
+  end
+
+let _ = at_exit close
+
+let level_of_node node =
+  if Hashtbl.length node_thresholds = 0 then !threshold
+  else try Hashtbl.find node_thresholds node with Not_found -> !threshold
+
+let enabled l = l >= level_of_node (current_node ())
+
+let write l node msg =
+  if !to_file then ns3_log_append l node msg
+  else print_endline msg
+
+let log ?node l msg =
+  let node = match node with Some n -> n | None -> current_node () in
+  if l >= level_of_node node then write l node msg
+
+let logf ?node l fmt = ksprintf (log ?node l) fmt
+
+let debug ?node fmt = logf ?node Debug fmt
+let info ?node fmt = logf ?node Info fmt
+let warn ?node fmt = logf ?node Warn fmt
+let error ?node fmt = logf ?node Error fmt
@@ -0,0 +1,70 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+(** Logging for simulation runs.
+
+    Until {!open_file} is called, messages are printed on stdout. After
+    it, they are appended as binary records, stamped with the simulated
+    time, the node and the level, to an in-memory ring. A background
+    thread writes the ring to the file in large batches, so logging does
+    not wait for the disk. The record format is described in
+    [log_ring.h]. *)
+
+type level = Debug | Info | Warn | Error
+
+val node_handle : int Lwt.key
+(** [node_handle] is the handle of the node that runs the current
+    thread, which is recorded with every message. It is the same key as
+    {!Topology.node_handle}. *)
+
+val set_level : level -> unit
+(** [set_level l] drops the messages below level [l], unless a node has
+    a level of its own. The default is [Info]. *)
+
+val set_node_level : int -> level option -> unit
+(** [set_node_level node (Some l)] drops the messages of node [node]
+    below level [l]. [set_node_level node None] makes the node use the
+    global level again. *)
+
+val open_file : ?ring_size:int -> string -> unit
+(** [open_file path] truncates [path] and sends the next messages to it,
+    through a ring of [ring_size] bytes (16MB by default). The file is
+    flushed and closed at exit.
+    @raise Invalid_argument if [ring_size] is less than 4KB. *)
+
+val flush : unit -> unit
+(** [flush ()] waits until every message logged so far is in the file. *)
+
+val close : unit -> unit
+(** [close ()] flushes and closes the file. Later messages are printed
+    on stdout. *)
+
+val enabled : level -> bool
+(** [enabled l] is true if a message of level [l] from the current node
+    would be logged. Use it to skip building expensive messages. *)
+
+val log : ?node:int -> level -> string -> unit
+(** [log l msg] logs [msg] at level [l] for the current node, or for
+    [node] if it is given, as it must be from the simulator callbacks,
+    which do not run in the thread of a node. *)
+
+val logf : ?node:int -> level -> ('a, unit, string, unit) format4 -> 'a
+(** [logf l fmt ...] formats a message and logs it as {!log} does. *)
+
+val debug : ?node:int -> ('a, unit, string, unit) format4 -> 'a
+val info : ?node:int -> ('a, unit, string, unit) format4 -> 'a
+val warn : ?node:int -> ('a, unit, string, unit) format4 -> 'a
+val error : ?node:int -> ('a, unit, string, unit) format4 -> 'a
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * The ring is a single buffer with free-running head (producer) and
+ * tail (writer) offsets. The simulation is the only producer, so a
+ * record is copied in with the lock held and the writer is woken only
+ * when a quarter of the ring is waiting, on a flush, or by a timeout
+ * that bounds how stale the file can get.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <log_ring.h>
+
+static struct {
+  char *buf;
+  size_t size;
+  uint64_t head, tail;
+  int fd;
+  int closing, flushing;
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t more, room;
+} ring = { NULL, 0, 0, 0, -1, 0, 0, 0,
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+  PTHREAD_COND_INITIALIZER };
+
+static void
+write_all(const char *p, size_t len) {
+  while (len > 0) {
+    ssize_t ret = write(ring.fd, p, len);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("log_ring write");
+      return;
+    }
+    p += ret;
+    len -= ret;
+  }
+}
+
+static void *
+writer_main(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&ring.lock);
+  for (;;) {
+    // sleep while there is nothing, or too little and no flush, to write
+    while (!ring.closing && (ring.head == ring.tail ||
+          (ring.head - ring.tail < ring.size / 4 && !ring.flushing))) {
+      struct timeval now;
+      struct timespec until;
+      gettimeofday(&now, NULL);
+      until.tv_sec = now.tv_sec + 1;
+      until.tv_nsec = now.tv_usec * 1000;
+      if (pthread_cond_timedwait(&ring.more, &ring.lock, &until) == ETIMEDOUT)
+        break;
+    }
+
+    uint64_t head = ring.head, tail = ring.tail;
+    if (head == tail) {
+      if (ring.closing)
+        break;
+      continue;
+    }
+
+    // the writer owns [tail, head) until it moves the tail
+    pthread_mutex_unlock(&ring.lock);
+    size_t start = tail % ring.size;
+    size_t len = head - tail;
+    if (start + len > ring.size) {
+      write_all(ring.buf + start, ring.size - start);
+      write_all(ring.buf, len - (ring.size - start));
+    } else
+      write_all(ring.buf + start, len);
+    pthread_mutex_lock(&ring.lock);
+
+    ring.tail = head;
+    pthread_cond_broadcast(&ring.room);
+  }
+  pthread_mutex_unlock(&ring.lock);
+  return NULL;
+}
+
+int
+log_ring_open(const char *path, size_t size) {
+  // records are cut to half of the ring, which must hold their header
+  if (size < LOG_RING_MIN_SIZE) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (ring.fd >= 0)
+    log_ring_close();
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return -1;
+  ring.buf = (char *)malloc(size);
+  if (ring.buf == NULL) {
+    close(fd);
+    errno = ENOMEM;
+    return -1;
+  }
+  ring.size = size;
+  ring.head = ring.tail = 0;
+  ring.fd = fd;
+  ring.closing = ring.flushing = 0;
+  write_all(LOG_RING_MAGIC, 8);
+  if (pthread_create(&ring.writer, NULL, writer_main, NULL) != 0) {
+    free(ring.buf);
+    close(fd);
+    ring.fd = -1;
+    errno = EAGAIN;
+    return -1;
+  }
+  return 0;
+}
+
+int
+log_ring_is_open(void) {
+  return ring.fd >= 0;
+}
+
+static void
+copy_in(uint64_t at, const void *p, size_t len) {
+  size_t start = at % ring.size;
+  if (start + len > ring.size) {
+    memcpy(ring.buf + start, p, ring.size - start);
+    memcpy(ring.buf, (const char *)p + (ring.size - start),
+        len - (ring.size - start));
+  } else
+    memcpy(ring.buf + start, p, len);
+}
+
+void
+log_ring_append(uint64_t time, int node, int level,
+    const char *msg, size_t len) {
+  if (ring.fd < 0)
+    return;
+  // a record may take at most half of the ring
+  if (LOG_RECORD_HEADER + len > ring.size / 2)
+    len = ring.size / 2 - LOG_RECORD_HEADER;
+
+  char hdr[LOG_RECORD_HEADER];
+  uint32_t len32 = len, level32 = level;
+  int32_t node32 = node;
+  memcpy(hdr, &len32, 4);
+  memcpy(hdr + 4, &node32, 4);
+  memcpy(hdr + 8, &level32, 4);
+  memcpy(hdr + 12, &time, 8);
+
+  size_t need = LOG_RECORD_HEADER + len;
+  pthread_mutex_lock(&ring.lock);
+  while (ring.size - (ring.head - ring.tail) < need) {
+    pthread_cond_signal(&ring.more);
+    pthread_cond_wait(&ring.room, &ring.lock);
+  }
+  copy_in(ring.head, hdr, LOG_RECORD_HEADER);
+  copy_in(ring.head + LOG_RECORD_HEADER, msg, len);
+  ring.head += need;
+  if (ring.head - ring.tail >= ring.size / 4)
+    pthread_cond_signal(&ring.more);
+  pthread_mutex_unlock(&ring.lock);
+}
+
+void
+log_ring_flush(void) {
+  if (ring.fd < 0)
+    return;
+  pthread_mutex_lock(&ring.lock);
+  ring.flushing = 1;
+  while (ring.tail != ring.head) {
+    pthread_cond_signal(&ring.more);
+    pthread_cond_wait(&ring.room, &ring.lock);
+  }
+  ring.flushing = 0;
+  pthread_mutex_unlock(&ring.lock);
+}
+
+void
+log_ring_close(void) {
+  if (ring.fd < 0)
+    return;
+  pthread_mutex_lock(&ring.lock);
+  ring.closing = 1;
+  pthread_cond_signal(&ring.more);
+  pthread_mutex_unlock(&ring.lock);
+  pthread_join(ring.writer, NULL);
+  close(ring.fd);
+  ring.fd = -1;
+  free(ring.buf);
+  ring.buf = NULL;
+}
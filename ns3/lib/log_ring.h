@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * A log of binary records, appended to an in-memory ring by the
+ * simulation and written to a file in large batches by a background
+ * thread. The file starts with the 8 bytes "MIRLOG01", followed by
+ * records in host byte order:
+ *
+ *   uint32 len     length of the message
+ *   int32  node    node handle, or -1
+ *   uint32 level   0 debug, 1 info, 2 warning, 3 error
+ *   uint64 time    simulated time in ns
+ *   len bytes      the message
+ */
+
+#ifndef MIRAGE_LOG_RING_H
+#define MIRAGE_LOG_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LOG_RING_MAGIC "MIRLOG01"
+#define LOG_RECORD_HEADER 20
+#define LOG_RING_MIN_SIZE 4096
+
+/* Open the log file and start the writer. Returns -1 and sets errno if
+   the file cannot be created, or to EINVAL if [size] is smaller than
+   LOG_RING_MIN_SIZE. */
+int log_ring_open(const char *path, size_t size);
+
+int log_ring_is_open(void);
+
+/* Append a record, waiting for the writer if the ring is full. */
+void log_ring_append(uint64_t time, int node, int level,
+    const char *msg, size_t len);
+
+/* Wait until every record appended so far is in the file. */
+void log_ring_flush(void);
+
+/* Flush, stop the writer and close the file. */
+void log_ring_close(void);
+
+#endif /* MIRAGE_LOG_RING_H */
@@ -24,7 +24,8 @@
 open Printf
 open Lwt
 
-external ns3_run : int -> int = "ocaml_ns3_run" 
+let debug = ref false
+let set_debug d = debug := d
 
 let exit_hooks = Lwt_sequence.create ()
 let enter_hooks = Lwt_sequence.create ()
@@ -37,32 +38,57 @@ let rec call_hooks hooks  =
         let _ = f () in
           call_hooks hooks
 
-(* Main runloop, which registers a callback so it can be invoked
-   when timeouts expire. Thus, the program may only call this function
-   once and once only. *)
+external ns3_schedule_iterate : unit -> unit = "ocaml_ns3_schedule_iterate"
+
+(* Threads that pause again when they are woken up are woken up again,
+   up to this many times, before control goes back to the simulator. *)
+let max_wakeup_rounds = 16
+
+(* Whether a zero-delay simulator event will call [iterate] again. *)
+let iterate_scheduled = ref false
+
+(* Run the threads that the last simulator event made runnable. The
+   stubs call this once after each event they deliver to OCaml (timer,
+   received frame, unblocked queue, node start), and then return to
+   Simulator::Run, which drives the simulation. Threads that are still
+   paused at the end get a zero-delay event of their own, since there
+   may be no other event to wake them up. *)
+let iterate () =
+  iterate_scheduled := false;
+  let rec wakeup i =
+    if i < max_wakeup_rounds && Lwt.paused_count () > 0 then begin
+      Lwt.wakeup_paused ();
+      wakeup (i + 1)
+    end in
+  wakeup 0;
+  Time.restart_threads Clock.time;
+  if Lwt.paused_count () > 0 && not !iterate_scheduled then begin
+    iterate_scheduled := true;
+    ns3_schedule_iterate ()
+  end
+
+let _ = Callback.register "main_iterate" iterate
+
+(* Main runloop. While the simulation runs, threads are driven by
+   [iterate] from the simulator's events, so this only has to finish
+   the threads that can still make progress on their own. *)
 let run t =
   Printexc.record_backtrace true;
   let rec fn () =
-    Gc.compact ();  
-    (* Wake up any paused threads, and restart threads waiting on timeout *)
-    printf "main called\n%!";
-    Lwt.wakeup_paused ();
-    Time.restart_threads Clock.time;
-    (* Attempt to advance the main loop thread *)
+    iterate ();
     match Lwt.poll t with
     | Some x ->
        (* The main thread has completed, so return the value *)
        x
-    | None -> 
-       (* If we have nothing to do, then check for the next
-          timeout and block the domain *)
-       let timeout =
-         match Time.select_next Clock.time with
-         |None -> 86400.0
-         |Some tm -> tm
-       in
-        printf "sleep for %f seconds\n%!" timeout;
-       fn ()
+    | None ->
+       match Time.select_next Clock.time with
+       | Some timeout ->
+          if !debug then printf "Main: next timeout in %f seconds\n%!" timeout;
+          fn ()
+       | None ->
+          (* Only a simulator event can wake the remaining threads up,
+             and the simulation is over. *)
+          if !debug then printf "Main: no more events, leaving\n%!"
   in
   fn ()
 
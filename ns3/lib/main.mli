@@ -15,4 +15,11 @@
  *)
 
 val run : unit Lwt.t -> unit
+(** [run t] runs the threads that can make progress until [t] completes,
+    or until nothing but a simulator event could wake them up. During
+    the simulation, threads are run after every simulator event. *)
+
+val set_debug : bool -> unit
+(** [set_debug d] turns the scheduling messages of {!run} on or off. *)
+
 val at_enter : (unit -> unit Lwt.t) -> unit
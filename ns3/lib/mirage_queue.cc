@@ -18,9 +18,22 @@
 /* 
  * An ns3 net device queue to generate queue empty events and propagate them
  * to applications in order to avoid constant queue poling.
+ *
+ * Writers ask HasRoom before sending. Once it has said no, the queue is
+ * blocked until it drains to the low watermark, and only that crossing
+ * fires the unblock callback, so a writer resumes with room for a burst
+ * rather than being woken for every dequeued packet.
+ *
+ * Besides drop-tail, the queue can run RED on enqueue, or CoDel on dequeue
+ * over a single FIFO or over per-flow queues served by deficit round robin
+ * (FQ-CoDel). The early drops of these disciplines do not count towards
+ * the overflow drops, and every sent packet records its sojourn time.
  * */
+#include <math.h>
 #include <ns3/enum.h>
 #include <ns3/uinteger.h>
+#include <ns3/double.h>
+#include <ns3/simulator.h>
 #include <mirage_queue.h>
 
 NS_LOG_COMPONENT_DEFINE ("MirageQueue");
@@ -29,6 +42,12 @@ namespace ns3 {
 
 NS_OBJECT_ENSURE_REGISTERED (MirageQueue);
 
+// the largest frame we send, and its size in the queue, where the
+// device has put its 2-byte PPP header in front of it. The latter is
+// the CoDel MTU and FQ-CoDel quantum.
+static const uint32_t MAX_FRAME = 1514;
+static const uint32_t MAX_QUEUED_FRAME = MAX_FRAME + 2;
+
 TypeId MirageQueue::GetTypeId (void) 
 {
   static TypeId tid = TypeId ("ns3::MirageQueue")
@@ -50,6 +69,59 @@ TypeId MirageQueue::GetTypeId (void)
                    UintegerValue (100 * 65535),
                    MakeUintegerAccessor (&MirageQueue::m_maxBytes),
                    MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("LowWatermark", 
+                   "The fill level, in percent of the capacity, at which blocked writers are resumed.",
+                   UintegerValue (50),
+                   MakeUintegerAccessor (&MirageQueue::m_lowWatermark),
+                   MakeUintegerChecker<uint32_t> (0, 100))
+    .AddAttribute ("Discipline", 
+                   "The queue management discipline.",
+                   EnumValue (DISC_DROP_TAIL),
+                   MakeEnumAccessor (&MirageQueue::m_discipline),
+                   MakeEnumChecker (DISC_DROP_TAIL, "DropTail",
+                                    DISC_RED, "RED",
+                                    DISC_CODEL, "CoDel",
+                                    DISC_FQ_CODEL, "FQ-CoDel"))
+    .AddAttribute ("Target", 
+                   "The acceptable standing queue delay of CoDel.",
+                   TimeValue (MilliSeconds (5)),
+                   MakeTimeAccessor (&MirageQueue::m_target),
+                   MakeTimeChecker ())
+    .AddAttribute ("Interval", 
+                   "The sliding window over which CoDel looks at the minimum queue delay.",
+                   TimeValue (MilliSeconds (100)),
+                   MakeTimeAccessor (&MirageQueue::m_interval),
+                   MakeTimeChecker ())
+    .AddAttribute ("Flows", 
+                   "The number of flow queues of FQ-CoDel.",
+                   UintegerValue (1024),
+                   MakeUintegerAccessor (&MirageQueue::m_nFlows),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("Quantum", 
+                   "The bytes a FQ-CoDel flow may send in each round.",
+                   UintegerValue (MAX_QUEUED_FRAME),
+                   MakeUintegerAccessor (&MirageQueue::m_quantum),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("MinTh", 
+                   "The average fill, in percent of the capacity, at which RED starts dropping.",
+                   DoubleValue (25),
+                   MakeDoubleAccessor (&MirageQueue::m_minTh),
+                   MakeDoubleChecker<double> (0, 100))
+    .AddAttribute ("MaxTh", 
+                   "The average fill, in percent of the capacity, above which RED drops every packet.",
+                   DoubleValue (75),
+                   MakeDoubleAccessor (&MirageQueue::m_maxTh),
+                   MakeDoubleChecker<double> (0, 100))
+    .AddAttribute ("MaxP", 
+                   "The RED drop probability at MaxTh.",
+                   DoubleValue (0.1),
+                   MakeDoubleAccessor (&MirageQueue::m_maxP),
+                   MakeDoubleChecker<double> (0, 1))
+    .AddAttribute ("QueueWeight", 
+                   "The weight of the current fill in the RED average.",
+                   DoubleValue (0.002),
+                   MakeDoubleAccessor (&MirageQueue::m_weight),
+                   MakeDoubleChecker<double> (0, 1))
   ;
 
   return tid;
@@ -57,8 +129,21 @@ TypeId MirageQueue::GetTypeId (void)
 
 MirageQueue::MirageQueue () :
   Queue (),
-  m_packets (),
-  m_bytesInQueue (0)
+  m_nPackets (0),
+  m_bytesInQueue (0),
+  m_blocked (false),
+  m_mode (QUEUE_MODE_PACKETS),
+  m_discipline (DISC_DROP_TAIL),
+  m_avg (0),
+  m_redCount (-1),
+  m_rand (0x2545F4914F6CDD1DULL),
+  m_overflowDrops (0),
+  m_aqmDrops (0),
+  m_sojournCount (0),
+  m_txBytes (0),
+  m_sojournSum (0),
+  m_sojournMax (0),
+  m_lastEnqueued (0)
 {
   NS_LOG_FUNCTION_NOARGS ();
 }
@@ -82,79 +167,423 @@ MirageQueue::GetMode (void)
   return m_mode;
 }
 
+// The attributes are set after construction, so the flow queues are
+// created with the first packet.
+void
+MirageQueue::Setup (void)
+{
+  uint32_t n = (m_discipline == DISC_FQ_CODEL) ? m_nFlows : 1;
+  Flow f;
+  f.bytes = 0;
+  f.deficit = 0;
+  f.active = false;
+  f.codel.firstAboveTime = 0;
+  f.codel.dropNext = 0;
+  f.codel.count = 0;
+  f.codel.lastCount = 0;
+  f.codel.dropping = false;
+  m_flows.assign (n, f);
+}
+
+// Hash the IPv4 addresses, protocol and ports of a frame. Queued packets
+// carry the PPP header of the device in front of the Ethernet frame.
+uint32_t
+MirageQueue::Classify (Ptr<const Packet> p) const
+{
+  uint8_t buf[2 + 14 + 60 + 4];
+  uint32_t len = p->CopyData (buf, sizeof (buf));
+  const uint8_t *ip = buf + 2 + 14;
+  if (len < 2 + 14 + 20 || buf[2 + 12] != 0x08 || buf[2 + 13] != 0x00)
+    return 0;
+
+  uint32_t ihl = (ip[0] & 0x0f) * 4;
+  uint32_t h = 2166136261u;
+  for (int i = 12; i < 20; i++)
+    h = (h ^ ip[i]) * 16777619u;
+  h = (h ^ ip[9]) * 16777619u;
+  if ((ip[9] == 6 || ip[9] == 17) && len >= 2 + 14 + ihl + 4)
+    for (uint32_t i = ihl; i < ihl + 4; i++)
+      h = (h ^ ip[i]) * 16777619u;
+  return h % m_flows.size ();
+}
+
+// xorshift64*: RED only needs a cheap, reproducible uniform in [0, 1)
+double
+MirageQueue::Random (void)
+{
+  m_rand ^= m_rand >> 12;
+  m_rand ^= m_rand << 25;
+  m_rand ^= m_rand >> 27;
+  return (double)((m_rand * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+bool
+MirageQueue::RedEarlyDrop (void)
+{
+  double cap = GetCapacity ();
+  double minTh = cap * m_minTh / 100;
+  double maxTh = cap * m_maxTh / 100;
+
+  m_avg = (1 - m_weight) * m_avg + m_weight * GetFill ();
+  if (m_avg < minTh)
+    {
+      m_redCount = -1;
+      return false;
+    }
+  if (m_avg >= maxTh)
+    {
+      m_redCount = 0;
+      return true;
+    }
+
+  // spread the drops evenly: the probability grows with the packets
+  // accepted since the last drop
+  m_redCount++;
+  double pb = m_maxP * (m_avg - minTh) / (maxTh - minTh);
+  double pa = (m_redCount * pb >= 1) ? 1 : pb / (1 - m_redCount * pb);
+  if (Random () < pa)
+    {
+      m_redCount = 0;
+      return true;
+    }
+  return false;
+}
+
 bool 
 MirageQueue::DoEnqueue (Ptr<Packet> p)
 {
   NS_LOG_FUNCTION (this << p);
 
-  if (m_mode == QUEUE_MODE_PACKETS && (m_packets.size () >= m_maxPackets))
+  if (m_flows.empty ())
+    Setup ();
+
+  if (m_mode == QUEUE_MODE_PACKETS && (m_nPackets >= m_maxPackets))
     {
-      NS_LOG_LOGIC ("Queue full (at max packets) -- droppping pkt");
-      Drop (p);
-      return false;
+      if (m_discipline != DISC_FQ_CODEL)
+        {
+          NS_LOG_LOGIC ("Queue full (at max packets) -- droppping pkt");
+          m_overflowDrops++;
+          Drop (p);
+          return false;
+        }
+      DropFromLongestFlow ();
     }
 
   if (m_mode == QUEUE_MODE_BYTES && (m_bytesInQueue + p->GetSize () >= m_maxBytes))
     {
-      NS_LOG_LOGIC ("Queue full (packet would exceed max bytes) -- droppping pkt");
+      if (m_discipline != DISC_FQ_CODEL)
+        {
+          NS_LOG_LOGIC ("Queue full (packet would exceed max bytes) -- droppping pkt");
+          m_overflowDrops++;
+          Drop (p);
+          return false;
+        }
+      while (m_nPackets > 0 && m_bytesInQueue + p->GetSize () >= m_maxBytes)
+        DropFromLongestFlow ();
+    }
+
+  if (m_discipline == DISC_RED && RedEarlyDrop ())
+    {
+      NS_LOG_LOGIC ("RED early drop, average " << m_avg);
+      m_aqmDrops++;
       Drop (p);
       return false;
     }
 
+  uint32_t ix = (m_discipline == DISC_FQ_CODEL) ? Classify (p) : 0;
+  Flow &f = m_flows[ix];
+  Entry e;
+  e.packet = p;
+  e.enqueued = Simulator::Now ().GetNanoSeconds ();
+  f.entries.push (e);
+  f.bytes += p->GetSize ();
   m_bytesInQueue += p->GetSize ();
-  m_packets.push (p);
+  m_nPackets++;
+
+  if (m_discipline == DISC_FQ_CODEL && !f.active)
+    {
+      f.active = true;
+      f.deficit = m_quantum;
+      m_newFlows.push_back (ix);
+    }
 
-  NS_LOG_LOGIC ("Number packets " << m_packets.size ());
+  NS_LOG_LOGIC ("Number packets " << m_nPackets);
   NS_LOG_LOGIC ("Number bytes " << m_bytesInQueue);
 
   return true;
 }
 
+// FQ-CoDel overflow: drop the head of the flow with the largest backlog,
+// so the flow that caused it pays for it
+void
+MirageQueue::DropFromLongestFlow (void)
+{
+  uint32_t longest = 0;
+  for (uint32_t i = 1; i < m_flows.size (); i++)
+    if (m_flows[i].bytes > m_flows[longest].bytes)
+      longest = i;
+  if (m_flows[longest].entries.empty ())
+    return;
+  NS_LOG_LOGIC ("Queue full -- dropping from flow " << longest);
+  m_overflowDrops++;
+  Drop (Pop (m_flows[longest]));
+}
+
+Ptr<Packet>
+MirageQueue::Pop (Flow &f)
+{
+  Ptr<Packet> p = f.entries.front ().packet;
+  m_lastEnqueued = f.entries.front ().enqueued;
+  f.entries.pop ();
+  f.bytes -= p->GetSize ();
+  m_bytesInQueue -= p->GetSize ();
+  m_nPackets--;
+  return p;
+}
+
+void
+MirageQueue::AqmDrop (Ptr<Packet> p)
+{
+  NS_LOG_LOGIC ("CoDel drop " << p);
+  m_aqmDrops++;
+  Drop (p);
+}
+
+// dodequeue of RFC 8289: pop the head and tell whether its sojourn time
+// has stayed above the target for a whole interval
+Ptr<Packet>
+MirageQueue::CodelPop (Flow &f, int64_t now, bool &okToDrop)
+{
+  okToDrop = false;
+  if (f.entries.empty ())
+    {
+      f.codel.firstAboveTime = 0;
+      return 0;
+    }
+
+  int64_t sojourn = now - f.entries.front ().enqueued;
+  Ptr<Packet> p = Pop (f);
+  if (sojourn < m_target.GetNanoSeconds () || m_bytesInQueue <= MAX_QUEUED_FRAME)
+    f.codel.firstAboveTime = 0;
+  else if (f.codel.firstAboveTime == 0)
+    f.codel.firstAboveTime = now + m_interval.GetNanoSeconds ();
+  else if (now >= f.codel.firstAboveTime)
+    okToDrop = true;
+  return p;
+}
+
+static int64_t
+ControlLaw (int64_t t, int64_t interval, uint32_t count)
+{
+  return t + (int64_t)(interval / sqrt ((double)count));
+}
+
+Ptr<Packet>
+MirageQueue::CodelDequeue (Flow &f)
+{
+  Codel &c = f.codel;
+  int64_t now = Simulator::Now ().GetNanoSeconds ();
+  int64_t interval = m_interval.GetNanoSeconds ();
+  bool okToDrop;
+  Ptr<Packet> p = CodelPop (f, now, okToDrop);
+
+  if (c.dropping)
+    {
+      if (!okToDrop)
+        c.dropping = false;
+      while (c.dropping && now >= c.dropNext && p != 0)
+        {
+          AqmDrop (p);
+          c.count++;
+          p = CodelPop (f, now, okToDrop);
+          if (!okToDrop)
+            c.dropping = false;
+          else
+            c.dropNext = ControlLaw (c.dropNext, interval, c.count);
+        }
+    }
+  else if (okToDrop && p != 0)
+    {
+      AqmDrop (p);
+      p = CodelPop (f, now, okToDrop);
+      c.dropping = true;
+      // start from the drop rate of the last dropping state if it
+      // ended recently
+      uint32_t delta = c.count - c.lastCount;
+      c.count = (delta > 1 && now - c.dropNext < 16 * interval) ? delta : 1;
+      c.dropNext = ControlLaw (now, interval, c.count);
+      c.lastCount = c.count;
+    }
+  return p;
+}
+
+Ptr<Packet>
+MirageQueue::FqCodelDequeue (void)
+{
+  for (;;)
+    {
+      std::list<uint32_t> *l;
+      if (!m_newFlows.empty ())
+        l = &m_newFlows;
+      else if (!m_oldFlows.empty ())
+        l = &m_oldFlows;
+      else
+        return 0;
+
+      uint32_t ix = l->front ();
+      Flow &f = m_flows[ix];
+      if (f.deficit <= 0)
+        {
+          f.deficit += m_quantum;
+          l->pop_front ();
+          m_oldFlows.push_back (ix);
+          continue;
+        }
+
+      Ptr<Packet> p = CodelDequeue (f);
+      if (p == 0)
+        {
+          // an emptied new flow goes through the old list once, so it
+          // cannot jump the queue by coming back at once
+          l->pop_front ();
+          if (l == &m_newFlows && !m_oldFlows.empty ())
+            m_oldFlows.push_back (ix);
+          else
+            f.active = false;
+          continue;
+        }
+      f.deficit -= p->GetSize ();
+      return p;
+    }
+}
+
 Ptr<Packet>
 MirageQueue::DoDequeue (void)
 {
   NS_LOG_FUNCTION (this);
 
-  if (m_packets.empty ())
+  if (m_nPackets == 0)
     {
       NS_LOG_LOGIC ("Queue empty");
       return 0;
     }
 
-  Ptr<Packet> p = m_packets.front ();
-  m_packets.pop ();
-  m_bytesInQueue -= p->GetSize ();
+  Ptr<Packet> p;
+  switch (m_discipline)
+    {
+    case DISC_CODEL:
+      p = CodelDequeue (m_flows[0]);
+      break;
+    case DISC_FQ_CODEL:
+      p = FqCodelDequeue ();
+      break;
+    default:
+      p = Pop (m_flows[0]);
+      break;
+    }
+
+  if (p == 0)
+    {
+      NS_LOG_LOGIC ("Queue emptied by CoDel drops");
+      return 0;
+    }
+
+  // the packet that is sent was the last one popped
+  int64_t sojourn = Simulator::Now ().GetNanoSeconds () - m_lastEnqueued;
+  m_sojournCount++;
+  m_txBytes += p->GetSize ();
+  m_sojournSum += sojourn;
+  if (sojourn > m_sojournMax)
+    m_sojournMax = sojourn;
 
   NS_LOG_LOGIC ("Popped " << p);
 
-  NS_LOG_LOGIC ("Number packets " << m_packets.size ());
+  NS_LOG_LOGIC ("Number packets " << m_nPackets);
   NS_LOG_LOGIC ("Number bytes " << m_bytesInQueue);
 
-  if (!this->m_unblockCallback.IsNull ()) {
-     Simulator::ScheduleNow(&MirageQueue::NotifyQueueEmpty, this);
-  }
+  if (m_blocked && 
+      (uint64_t)GetFill () * 100 <= (uint64_t)GetCapacity () * m_lowWatermark)
+    {
+      NS_LOG_LOGIC ("Queue below low watermark -- unblocking writers");
+      m_blocked = false;
+      if (!this->m_unblockCallback.IsNull ())
+        Simulator::ScheduleNow(&MirageQueue::NotifyUnblock, this);
+    }
   return p;
 }
 
 void
-MirageQueue::NotifyQueueEmpty() {
+MirageQueue::NotifyUnblock() {
   this->m_unblockCallback(this->m_device);
 }
 
+uint32_t
+MirageQueue::GetFill (void) const
+{
+  return (m_mode == QUEUE_MODE_BYTES) ? m_bytesInQueue : m_nPackets;
+}
+
+uint32_t
+MirageQueue::GetCapacity (void) const
+{
+  return (m_mode == QUEUE_MODE_BYTES) ? m_maxBytes : m_maxPackets;
+}
+
+bool
+MirageQueue::HasRoom (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  if (!m_blocked)
+    {
+      // in byte mode, the next packet may be a full frame, and
+      // DoEnqueue drops a packet that would fill the queue exactly
+      uint32_t need = (m_mode == QUEUE_MODE_BYTES) ? MAX_QUEUED_FRAME + 1 : 1;
+      if (GetFill () + need > GetCapacity ())
+        {
+          NS_LOG_LOGIC ("Queue at high watermark -- blocking writers");
+          m_blocked = true;
+        }
+    }
+  return !m_blocked;
+}
+
+Time
+MirageQueue::GetAverageSojourn (void) const
+{
+  if (m_sojournCount == 0)
+    return Seconds (0);
+  return NanoSeconds (m_sojournSum / (int64_t)m_sojournCount);
+}
+
 Ptr<const Packet>
 MirageQueue::DoPeek (void) const
 {
   NS_LOG_FUNCTION (this);
 
-  if (m_packets.empty ())
+  if (m_nPackets == 0)
     {
       NS_LOG_LOGIC ("Queue empty");
       return 0;
     }
 
-  Ptr<Packet> p = m_packets.front ();
+  // the head of the flow that is served next, unless CoDel drops it
+  uint32_t ix = 0;
+  if (m_discipline == DISC_FQ_CODEL)
+    {
+      std::list<uint32_t>::const_iterator it;
+      for (it = m_newFlows.begin (); it != m_newFlows.end (); it++)
+        if (!m_flows[*it].entries.empty ())
+          break;
+      if (it == m_newFlows.end ())
+        for (it = m_oldFlows.begin (); it != m_oldFlows.end (); it++)
+          if (!m_flows[*it].entries.empty ())
+            break;
+      ix = *it;
+    }
+  Ptr<Packet> p = m_flows[ix].entries.front ().packet;
 
-  NS_LOG_LOGIC ("Number packets " << m_packets.size ());
+  NS_LOG_LOGIC ("Number packets " << m_nPackets);
   NS_LOG_LOGIC ("Number bytes " << m_bytesInQueue);
 
   return p;
@@ -26,10 +26,13 @@
 #define MIRAGE_QUEUE_H
 
 #include <queue>
+#include <list>
+#include <vector>
 #include <ns3/packet.h>
 #include <ns3/queue.h>
 #include <ns3/net-device.h>
 #include <ns3/log.h>
+#include <ns3/nstime.h>
 
 namespace ns3 {
 
@@ -38,7 +41,8 @@ class TraceContainer;
 /**
  * \ingroup queue
  *
- * \brief A FIFO packet queue that drops tail-end packets on overflow
+ * \brief A packet queue that drops tail-end packets on overflow, with
+ * optional RED, CoDel or FQ-CoDel active queue management
  */
 class MirageQueue : public Queue {
 
@@ -49,6 +53,14 @@ public:
     QUEUE_MODE_BYTES,       /**< Use number of bytes for maximum queue size */
   };
 
+  enum QueueDiscipline
+  {
+    DISC_DROP_TAIL,         /**< Drop arriving packets when full */
+    DISC_RED,               /**< Random Early Detection (Floyd, Jacobson 1993) */
+    DISC_CODEL,             /**< Controlled Delay (RFC 8289) */
+    DISC_FQ_CODEL,          /**< Flow queueing with CoDel per flow (RFC 8290) */
+  };
+
 
   typedef Callback< bool, Ptr<NetDevice> > QueueUnblockCallback;
 
@@ -79,17 +91,109 @@ public:
 
   void SetUnblockCallback(QueueUnblockCallback cb, Ptr<NetDevice> dev);
 
+  /**
+   * Check whether a writer may enqueue another packet.
+   *
+   * \returns false if the queue is at its high watermark (its
+   * capacity, less one frame in byte mode). The queue then stays
+   * blocked, and the unblock callback runs once, when dequeues bring
+   * it down to the low watermark.
+   */
+  bool HasRoom (void);
+
+  /**
+   * Statistics of the queue since it was created. Packets dropped on
+   * overflow and packets dropped early by the discipline are counted
+   * apart. Sojourn times are those of the packets that were sent.
+   */
+  uint64_t GetOverflowDrops (void) const { return m_overflowDrops; }
+  uint64_t GetAqmDrops (void) const { return m_aqmDrops; }
+  uint64_t GetSojournCount (void) const { return m_sojournCount; }
+  uint64_t GetTxBytes (void) const { return m_txBytes; }
+  uint32_t GetQueuedPackets (void) const { return m_nPackets; }
+  uint32_t GetQueuedBytes (void) const { return m_bytesInQueue; }
+  Time GetAverageSojourn (void) const;
+  Time GetMaxSojourn (void) const { return NanoSeconds (m_sojournMax); }
+
 private:
+  // a queued packet and the time at which it arrived, in ns
+  struct Entry
+  {
+    Ptr<Packet> packet;
+    int64_t enqueued;
+  };
+
+  // CoDel control state, one per flow
+  struct Codel
+  {
+    int64_t firstAboveTime;
+    int64_t dropNext;
+    uint32_t count;
+    uint32_t lastCount;
+    bool dropping;
+  };
+
+  struct Flow
+  {
+    std::queue<Entry> entries;
+    uint32_t bytes;
+    int32_t deficit;
+    bool active;                /* on the new or the old list */
+    Codel codel;
+  };
+
   virtual bool DoEnqueue (Ptr<Packet> p);
   virtual Ptr<Packet> DoDequeue (void);
   virtual Ptr<const Packet> DoPeek (void) const;
-  void NotifyQueueEmpty(void);
-
-  std::queue<Ptr<Packet> > m_packets;
+  void NotifyUnblock(void);
+  uint32_t GetFill (void) const;
+  uint32_t GetCapacity (void) const;
+
+  void Setup (void);
+  uint32_t Classify (Ptr<const Packet> p) const;
+  Ptr<Packet> Pop (Flow &f);
+  Ptr<Packet> CodelPop (Flow &f, int64_t now, bool &okToDrop);
+  Ptr<Packet> CodelDequeue (Flow &f);
+  Ptr<Packet> FqCodelDequeue (void);
+  bool RedEarlyDrop (void);
+  void DropFromLongestFlow (void);
+  void AqmDrop (Ptr<Packet> p);
+  double Random (void);
+
+  std::vector<Flow> m_flows;    /* a single flow unless FQ-CoDel */
+  std::list<uint32_t> m_newFlows;
+  std::list<uint32_t> m_oldFlows;
+  uint32_t m_nPackets;
   uint32_t m_maxPackets;
   uint32_t m_maxBytes;
   uint32_t m_bytesInQueue;
+  uint32_t m_lowWatermark;
+  bool m_blocked;
   QueueMode m_mode;
+  QueueDiscipline m_discipline;
+
+  // CoDel and FQ-CoDel
+  Time m_target;
+  Time m_interval;
+  uint32_t m_nFlows;
+  uint32_t m_quantum;
+
+  // RED
+  double m_minTh;
+  double m_maxTh;
+  double m_maxP;
+  double m_weight;
+  double m_avg;
+  int32_t m_redCount;
+  uint64_t m_rand;
+
+  uint64_t m_overflowDrops;
+  uint64_t m_aqmDrops;
+  uint64_t m_sojournCount;       /* packets sent */
+  uint64_t m_txBytes;
+  int64_t m_sojournSum;
+  int64_t m_sojournMax;
+  int64_t m_lastEnqueued;       /* arrival time of the last popped packet */
   MirageQueue::QueueUnblockCallback m_unblockCallback;
   Ptr<NetDevice> m_device;
 };
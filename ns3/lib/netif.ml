@@ -33,6 +33,8 @@ type stats = {
 
 type t = {
   id: id;
+  node: int;  (* handle of the node, see Topology.node_handle *)
+  ix: int;    (* index of the device in the node *)
   fd_read : Cstruct.t Lwt_condition.t;
   fd_read_ret : unit Lwt_condition.t;
   fd_write : unit Lwt_condition.t;
@@ -41,89 +43,109 @@ type t = {
   stats : stats;
 }
 
-external pkt_write: string -> int -> Io_page.t -> int -> int -> unit = "caml_pkt_write"
-external queue_check: string -> int -> bool = "caml_queue_check"
-external register_check_queue: string -> int -> unit =
+external pkt_write: int -> int -> Io_page.t -> int -> int -> unit = "caml_pkt_write"
+external pkt_writev: int -> int -> Cstruct.t list -> unit = "caml_pkt_writev"
+external queue_check: int -> int -> bool = "caml_queue_check"
+external register_check_queue: int -> int -> unit =
   "caml_register_check_queue"
 exception Ethif_closed
 
-let devices = Hashtbl.create 1
+(* Devices by node handle and device index, the way the simulator
+   refers to them. *)
+let devices : t option array array ref = ref [||]
+
+let find_dev node ix =
+  let devs = !devices in
+  if node < Array.length devs && ix < Array.length devs.(node) then
+    match devs.(node).(ix) with
+    | Some t -> t
+    | None -> raise Not_found
+  else raise Not_found
+
+let grow a n x =
+  if n <= Array.length a then a else begin
+    let b = Array.make n x in
+    Array.blit a 0 b 0 (Array.length a);
+    b
+  end
 
 let ethernet_mac_to_string x =
     let chri i = Char.code x.[i] in
     Printf.sprintf "%02x:%02x:%02x:%02x:%02x:%02x"
        (chri 0) (chri 1) (chri 2) (chri 3) (chri 4) (chri 5)
 
-let plug node_name id mac =
+let plug node ix mac =
  let active = true in
  let fd_read = Lwt_condition.create () in
  let fd_read_ret = Lwt_condition.create  () in 
  let fd_write = Lwt_condition.create () in
- let t = { id=(string_of_int id); fd_read; fd_read_ret;
+ let t = { id=(string_of_int ix); node; ix; fd_read; fd_read_ret;
            active; fd_write; mac; stats={rx_pkts=0l;rx_bytes=0L;tx_pkts=0l;tx_bytes=0L;};} in
  let _ = 
-   if (Hashtbl.mem devices node_name) then (
-     let devs = Hashtbl.find devices node_name in 
-       Hashtbl.replace devices node_name (devs @ [t])
-   ) else (
-     Hashtbl.replace devices node_name [t]
-   )
+   devices := grow !devices (node + 1) [||];
+   !devices.(node) <- grow !devices.(node) (ix + 1) None;
+   !devices.(node).(ix) <- Some t
  in
-   printf "Netif: plug %s.%d\n%!" node_name id;
+   Log.info ~node "Netif: plug %s.%d" (Topology.name_of_handle node) ix;
    return t
 
 
-let demux_pkt node_name dev_id frame = 
+external page_has_views : Io_page.t -> bool = "caml_page_has_views"
+
+(* Received frames are copied by the simulator straight into pages of
+   this pool. A page goes back to the pool once the stack has dropped
+   every reference to it. Views made with Bigarray.Array1.sub (by
+   Cstruct.to_bigarray or Io_page.to_pages, for instance) keep the
+   memory alive without referencing the page, so a page that still has
+   views is left to the GC instead, which frees it with the last one. *)
+let rx_pool = Stack.create ()
+
+let release_rx_page page =
+  if not (page_has_views page) then Stack.push page rx_pool
+
+let get_rx_page () =
+  let page =
+    if Stack.is_empty rx_pool then Io_page.get 1 else Stack.pop rx_pool in
+  Gc.finalise release_rx_page page;
+  page
+
+let demux_pkt node ix page pkt_len = 
   try
-    let pkt_len = String.length frame in
-      if ((pkt_len < 10) || (pkt_len > 1514)) then
-        printf "MALAKIA %d\n%!" pkt_len
-      else
-        let devs = Hashtbl.find devices node_name in 
-        let dev = 
-          List.find (
-            fun dev -> (dev.id = (string_of_int dev_id)) ) devs in
-        let pkt = Io_page.to_cstruct (Io_page.get 1) in 
-        let _ = (Cstruct.blit_from_string frame 0 pkt 0 pkt_len) in
-        let pkt = Cstruct.sub pkt 0 pkt_len in 
-
-        let _ = Lwt_condition.signal dev.fd_read pkt in
-        let _ = resolve (Lwt_condition.wait dev.fd_read_ret) in
-        let _ = Lwt.wakeup_paused () in 
-        let _ = Lwt.wakeup_paused () in 
-        let _ = Lwt.wakeup_paused () in 
-        let _ = Lwt.wakeup_paused () in 
-        let _ = Lwt.wakeup_paused () in () 
+    let dev = find_dev node ix in
+    let pkt = Cstruct.sub (Io_page.to_cstruct page) 0 pkt_len in 
+
+    let _ = Lwt_condition.signal dev.fd_read pkt in
+    let _ = resolve (Lwt_condition.wait dev.fd_read_ret) in ()
   with 
   | Not_found ->
-    Printf.printf "Packet cannot be processed for node %s\n" node_name
+    Log.warn ~node "Packet cannot be processed for node %s"
+      (Topology.name_of_handle node)
   | ex ->
-    printf "Error %s\n" (Printexc.to_string ex)
+    Log.error ~node "Error %s" (Printexc.to_string ex)
+let _ = Callback.register "get_rx_page" get_rx_page
 let _ = Callback.register "demux_pkt" demux_pkt
 
 
-let unplug node_name id =
+let unplug node ix =
   try
-    let devs = Hashtbl.find devices node_name in
-    let _ = List.iter ( 
-        fun t ->
-          if (t.id = id) then
-            t.active <- false
-      ) devs in
-    let new_devs = List.filter (fun t -> t.id <> id) devs in
-      Hashtbl.replace devices node_name new_devs;
-      printf "Netif: unplug %s.%s\n%!" node_name id
-(*     Hashtbl.remove devices id *)
+    let t = find_dev node ix in
+      t.active <- false;
+      !devices.(node).(ix) <- None;
+      Log.info ~node "Netif: unplug %s.%d" (Topology.name_of_handle node) ix
   with Not_found -> ()
 
 let create () =
-  let name = 
-    match Lwt.get Topology.node_name with 
+  let node = 
+    match Lwt.get Topology.node_handle with 
       | None -> failwith "thread hasn't got a name"
-      | Some(name) -> name
+      | Some(node) -> node
   in
     try_lwt
-      let devs = Hashtbl.find devices name in
+      let devs =
+        if node < Array.length !devices then
+          Array.fold_right (fun d l ->
+            match d with Some t -> t :: l | None -> l) !devices.(node) []
+        else [] in
 (*      Lwt_list.fold_lefy_p (
         fun t ret -> 
           let user = fn t.id t in
@@ -132,7 +154,7 @@ let create () =
             th <?> user) devs [] *)
       return devs
     with exn -> 
-      let _ = printf "manager error %s\n%!" (Printexc.to_string exn) in 
+      Log.error "manager error %s" (Printexc.to_string exn);
       return []
 
 let get_writebuf t =
@@ -154,7 +176,7 @@ let rec listen t fn =
         let _ = Lwt.wakeup_paused () in 
           return ()
       with exn ->
-        return (printf "EXN: %s bt: %s\n%!" (Printexc.to_string exn) 
+        return (Log.error "EXN: %s bt: %s" (Printexc.to_string exn) 
                   (Printexc.get_backtrace()))
     in
       listen t fn
@@ -164,59 +186,44 @@ let rec listen t fn =
 (* Shutdown a netfront *)
 let destroy nf = return ()
 
-let unblock_device name ix = 
+let unblock_device node ix = 
   try
-    let devs = Hashtbl.find devices name in 
-    let dev = List.find 
-      (fun dev -> (dev.id = (string_of_int ix))) devs in
-    let _ =  Lwt_condition.signal dev.fd_write () in
-    let _ = Lwt.wakeup_paused () in 
-     ()
+    let dev = find_dev node ix in
+    (* the queue drained to its low watermark: resume every writer *)
+    Lwt_condition.broadcast dev.fd_write ()
   with Not_found ->
-    Printf.printf "Packet cannot be processed for node %s\n" name
+    Log.warn ~node "Packet cannot be processed for node %s"
+      (Topology.name_of_handle node)
+
+let rec wait_for_queue t = 
+  match (queue_check t.node t.ix) with
+  | true -> return ()
+  | false ->
+(*     let _ = printf "%03.6f: traffic blocked %d\n%!" (Clock.time ()) 
+       t.node in   *)
+    let _ = register_check_queue t.node t.ix in
+    lwt _ = Lwt_condition.wait t.fd_write in
+
+(*    let _ = printf "%03.6f: traffic unblocked %d\n%!" (Clock.time ())
+      t.node in  *)
+
+      wait_for_queue t
 
 (* Transmit a packet from an Io_page *)
 let write t page =
-  let rec wait_for_queue t node_name = 
-    match (queue_check node_name (int_of_string t.id)) with
-    | true -> return ()
-    | false ->
-(*       let _ = printf "%03.6f: traffic blocked %s\n%!" (Clock.time ()) 
-         node_name in   *)
-      let _ = register_check_queue node_name (int_of_string t.id) in
-      lwt _ = Lwt_condition.wait t.fd_write in
-
-(*      let _ = printf "%03.6f: traffic unblocked %s\n%!" (Clock.time ())
-        node_name in  *)
-
-        wait_for_queue t node_name
-    in
-  lwt _ = 
-    match (Lwt.get Topology.node_name) with
-    | None -> return ()
-    | Some(node_name) ->  
-      lwt _ = wait_for_queue t node_name in
-      return (pkt_write node_name (int_of_string t.id) 
-                page.Cstruct.buffer page.Cstruct.off page.Cstruct.len) 
-  in
-  return ()
-
+  lwt _ = wait_for_queue t in
+  return (pkt_write t.node t.ix
+            page.Cstruct.buffer page.Cstruct.off page.Cstruct.len)
 
-(* TODO use writev: but do a copy for now *)
+(* The simulator builds the packet from the fragments directly, copying
+   each of them once *)
 let writev t pages =
   match pages with
   |[] -> return ()
   |[page] -> write t page
   |pages ->
-    let page = Io_page.to_cstruct (Io_page.get 1) in
-    let off = ref 0 in
-    let _ = List.iter (fun p ->
-      let len = Cstruct.len p in
-      Cstruct.blit p 0 page !off len;
-      off := !off + len;
-    ) pages in 
-    let v = Cstruct.sub page 0 !off in
-      write t v
+    lwt _ = wait_for_queue t in
+    return (pkt_writev t.node t.ix pages)
   
 let id t = t.id
 let id_of_string id = id 
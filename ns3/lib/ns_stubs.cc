@@ -15,8 +15,8 @@
  */
  
 #include <unistd.h>
-#include <arpa/inet.h>
-#include <netinet/tcp.h>
+#include <errno.h>
+#include <vector>
 
 #include <ns3/core-module.h>
 #include <ns3/network-module.h>
@@ -40,6 +40,10 @@
 //#include <ns3/mirage-module.h>
 #include <mirage_queue.h>
 #include <mirage_queue.cc>
+#include <partition.h>
+#include <partition.cc>
+#include <log_ring.h>
+#include <log_ring.cc>
 
 using namespace std;
 using namespace ns3;
@@ -57,27 +61,36 @@ void ns3_init(void);
 //time event handling function
 CAMLprim value ocaml_ns3_add_timer_event(value, value);
 CAMLprim value ocaml_ns3_del_timer_event(value p_id);
+CAMLprim value ocaml_ns3_schedule_iterate(value v_unit);
 
 // topology functions
 CAMLprim value ocaml_ns3_add_node(value ocaml_name);
 CAMLprim value ocaml_ns3_add_link_bytecode(value * argv, int argn);
 CAMLprim value ocaml_ns3_add_link_native(value ocaml_node_a,
     value ocaml_node_b, value v_rate, value v_prop_d, value v_queue_size,
-    value v_pcap);
+    value v_queue_bytes, value v_discipline, value v_pcap);
 
 // net control mechanisms
-CAMLprim value caml_pkt_write(value v_node_name, value v_id, value v_ba,
+CAMLprim value caml_pkt_write(value v_node, value v_id, value v_ba,
     value v_off, value v_len);
-CAMLprim value caml_queue_check(value v_name,  value v_id);
-CAMLprim value ocaml_ns3_run(value, value, value, value);
+CAMLprim value caml_pkt_writev(value v_node, value v_id, value v_frags);
+CAMLprim value caml_queue_check(value v_node,  value v_id);
+CAMLprim value ocaml_ns3_run(value v_duration);
 CAMLprim value
-caml_register_check_queue(value v_name,  value v_id);
+caml_register_check_queue(value v_node,  value v_id);
 // CAMLprim value
 // ns3_add_net_intf(value v_intf, value v_node, value v_ip, value v_mask);
 CAMLprim value ocaml_ns3_log(value v_message);
-CAMLprim value 
-  ocaml_ns3_get_dev_byte_counter(value node_a, value node_b);
+CAMLprim value ocaml_ns3_log_open(value v_path, value v_size);
+CAMLprim value ocaml_ns3_log_append(value v_level, value v_node, value v_msg);
+CAMLprim value ocaml_ns3_log_flush(value v_unit);
+CAMLprim value ocaml_ns3_log_close(value v_unit);
+CAMLprim value ocaml_ns3_link_stats(value v_ba);
 CAMLprim value ocaml_ns3_log(value v_msg);
+
+// memory
+CAMLprim value caml_alloc_pages(value n_pages);
+CAMLprim value caml_page_has_views(value v_page);
  
 // export the c ocaml bindings in the c++ object files
 #include <caml/fail.h>
@@ -93,21 +106,42 @@ CAMLprim value ocaml_ns3_log(value v_msg);
 /*
  * State required to be stored in the c code
  */
+// One end of a link: its transmit queue, and what its device received
+struct link_end {
+  Ptr<MirageQueue> q;
+  uint64_t rx_packets;
+  uint64_t rx_bytes;
+};
+
 int node_count = 0;
 struct node_state {
   uint32_t node_id;
-  Ptr<Node> node;
+  string name;
+  uint32_t rank;          // MPI rank that simulates the node
+  Ptr<Node> node;         // created when the simulation starts
   bool *blocked_dev_mask;
+  vector<struct link_end *> ends;   // by device index
   node_state (){ }
 };
 
 map<string, struct node_state* > nodes;
+// Nodes are also given a dense handle, the node_id, at creation. The
+// per-packet functions index these tables instead of looking up names.
+vector<struct node_state *> node_table;      // by node_id
+vector<struct node_state *> node_of_ns3_id;  // by Node::GetId()
+
+static inline struct node_state *
+node_of_dev(Ptr<NetDevice> dev) {
+  return node_of_ns3_id[dev->GetNode()->GetId()];
+}
 struct caml_cb {
   value *init_cb;
   value *timer_cb;
   value *net_dev_cb;
   value *pkt_in_cb;
+  value *rx_page_cb;
   value *queue_unblock_cb;
+  value *iterate_cb;
 };
 
 struct caml_cb *ns3_cb = NULL;
@@ -136,41 +170,55 @@ hexdump(uint8_t *buf, int len) {
 double
 getTsLong() { return ((double)Simulator::Now().GetMicroSeconds() / 1e6); }
 
+// Run the OCaml threads made runnable by the event that was just
+// delivered, before control goes back to Simulator::Run.
+static void
+run_caml_threads() {
+  caml_callback(*(ns3_cb->iterate_cb), Val_unit);
+}
+
+// Give the threads that are still paused another turn, at the same
+// simulated time but after the events already due.
+CAMLprim value
+ocaml_ns3_schedule_iterate(value v_unit) {
+  Simulator::ScheduleNow(&run_caml_threads);
+  return Val_unit;
+}
+
 /*
  * Timed event methods
  */
-// event state
-map<int, EventId > events;
+// event state, indexed by the event ids that Time hands out. Ids are
+// dense and reused, and a slot holds a default EventId when no event is
+// pending for it.
+vector<EventId> events;
 static void
 TimerEventHandler(int id) {
-  map<int, EventId >::iterator it = events.find(id);
-  if (it != events.end()) {
-    events.erase(it);
-    caml_callback(*(ns3_cb->timer_cb), Val_int((int)id));
-  } else
-    printf("%03.6f: Event %d not found\n", getTsLong(), id);
+  events[id] = EventId();
+  caml_callback(*(ns3_cb->timer_cb), Val_int(id));
+  run_caml_threads();
 }
 
+// p_delay is in microseconds, the resolution of the simulator clock
 CAMLprim value
-ocaml_ns3_add_timer_event(value p_ts, value p_id) {
-  CAMLparam2(p_ts, p_id);
-  double ts = (Double_val(p_ts) * 1e6);
-  int id = Int_val(p_id);
-  events[id] = Simulator::Schedule(MicroSeconds (ts), &TimerEventHandler, id );
-  CAMLreturn( Val_unit );
+ocaml_ns3_add_timer_event(value p_delay, value p_id) {
+  size_t id = Int_val(p_id);
+  if (id >= events.size())
+    events.resize(2 * id + 1);
+  events[id] = Simulator::Schedule(MicroSeconds (Long_val(p_delay)),
+      &TimerEventHandler, (int)id);
+  return Val_unit;
 }
 
 CAMLprim value
 ocaml_ns3_del_timer_event(value p_id) {
-  CAMLparam1(p_id);
-  int id = Int_val(p_id);
-  map<int, EventId >::iterator it = events.find(id);
-  if (it != events.end()) {
-    Simulator::Cancel(it->second);
-    events.erase(it);
+  size_t id = Int_val(p_id);
+  if (id < events.size() && !events[id].IsExpired()) {
+    Simulator::Cancel(events[id]);
+    events[id] = EventId();
   } else
-    printf("%03.6f: Event %d not found\n", getTsLong(), id);
-  CAMLreturn(Val_unit);
+    printf("%03.6f: Event %d not found\n", getTsLong(), (int)id);
+  return Val_unit;
 }
 
 /*
@@ -178,15 +226,14 @@ ocaml_ns3_del_timer_event(value p_id) {
  */
 static void
 DeviceHandler(Ptr<NetDevice> dev) {
-  string name;
+  struct node_state *st = node_of_dev(dev);
   uint8_t *mac;
   value ml_mac;
 
   caml_register_global_root(&ml_mac);
-  name = Names::FindName(dev->GetNode());
-  nodes[name]->blocked_dev_mask = 
-    (bool *)realloc(nodes[name]->blocked_dev_mask, nodes[name]->node->GetNDevices());
-  nodes[name]->blocked_dev_mask[dev->GetIfIndex()] = false;
+  st->blocked_dev_mask = 
+    (bool *)realloc(st->blocked_dev_mask, st->node->GetNDevices());
+  st->blocked_dev_mask[dev->GetIfIndex()] = false;
 
   // fetch device mac address
   mac = (uint8_t *)malloc(Address::MAX_SIZE);
@@ -199,51 +246,100 @@ DeviceHandler(Ptr<NetDevice> dev) {
 
   // passing event to caml code
   caml_callback3(*caml_named_value("plug_dev"), 
-      caml_copy_string((const char *)name.c_str()),
-      Val_int(dev->GetIfIndex()), ml_mac);
+      Val_int(st->node_id), Val_int(dev->GetIfIndex()), ml_mac);
   caml_remove_global_root(&ml_mac);
 }
 
+/*
+ * Memory
+ */
+#define PAGE_SIZE 4096
+
+// Allocate a zeroed, page-aligned bigarray of n_pages pages. Like the
+// bigarrays made by Bigarray.Array1.create, it is freed by the bigarray
+// finaliser and speeds up the GC by its size over 1GB.
+CAMLprim value
+caml_alloc_pages(value n_pages) {
+  CAMLparam1(n_pages);
+  size_t len = Int_val(n_pages) * PAGE_SIZE;
+  void *block;
+
+  if (posix_memalign(&block, PAGE_SIZE, len) != 0)
+    caml_raise_out_of_memory();
+  memset(block, 0, len);
+  caml_adjust_gc_speed(len, 1 << 30);
+  CAMLreturn(caml_ba_alloc_dims(CAML_BA_UINT8 | CAML_BA_C_LAYOUT |
+        CAML_BA_MANAGED, 1, block, (intnat)len));
+}
+
+// Whether a bigarray made with Bigarray.Array1.sub (or slice, reshape)
+// still shares the memory of v_page. Those views and v_page share a
+// proxy, whose count drops when the finaliser of a view runs, so a view
+// that is dead but not yet swept still counts.
+CAMLprim value
+caml_page_has_views(value v_page) {
+  struct caml_ba_proxy *proxy = Caml_ba_array_val(v_page)->proxy;
+  return Val_bool(proxy != NULL && proxy->refcount > 1);
+}
+
 bool
-PktDemux(Ptr<NetDevice> dev, Ptr<const Packet> pktIn, uint16_t proto, 
+PktDemux(Ptr<NetDevice> dev, Ptr<const Packet> pkt, uint16_t proto, 
     const Address &src, const Address &dst, NetDevice::PacketType type) {
-  value ml_data;
-  caml_register_global_root(&ml_data);
-  Ptr<Packet> pkt = pktIn->Copy();
+  CAMLparam0();
+  CAMLlocalN(args, 4);
   int pkt_len = pkt->GetSize();
   if ((pkt_len < 10 ) || (pkt_len > 1514)) {
     printf("MALAKIA lower %d\n\n\n\n\n", pkt_len);
     exit(1);
   }
 
-  // find host name
-  string node_name = Names::FindName(dev->GetNode());
+  struct node_state *st = node_of_dev(dev);
+  struct link_end *end = st->ends[dev->GetIfIndex()];
+  end->rx_packets++;
+  end->rx_bytes += pkt_len;
 
-  ml_data = caml_alloc_string(pkt_len);
-  uint8_t *data = (uint8_t *)String_val(ml_data);
-  pkt->CopyData(data, pkt_len);
-//  printf("reading packet of type %x\n", *(uint16_t *)(data+12));
-  if ((caml_string_length(ml_data) < 10 ) || (caml_string_length(ml_data) > 1514)) {
-    printf("MALAKIA lower %d %d\n\n\n\n", pkt_len, caml_string_length(ml_data));
-    exit(1);
-  }
+  args[0] = Val_int(st->node_id);
+  args[1] = Val_int(dev->GetIfIndex());
+
+  // the only copy of the frame: straight into a page from the
+  // receive pool of Netif
+  args[2] = caml_callback(*ns3_cb->rx_page_cb, Val_unit);
+  pkt->CopyData((uint8_t *)Caml_ba_data_val(args[2]), pkt_len);
+  args[3] = Val_int(pkt_len);
 
   // call packet handling code in caml
-  caml_callback3(*ns3_cb->pkt_in_cb,
-      caml_copy_string((const char *)node_name.c_str()),
-      Val_int(dev->GetIfIndex()), ml_data );
-  caml_remove_global_root(&ml_data);
-  return true;
+  caml_callbackN(*ns3_cb->pkt_in_cb, 4, args);
+  run_caml_threads();
+  CAMLreturnT(bool, true);
+}
+
+static void
+send_packet(int node_id, uint32_t ifIx, Ptr<Packet> pkt, const uint8_t *mac) {
+  // find the right device for the node and send packet
+  Ptr<Node> node = node_table[node_id]->node;
+
+  //find the dst mac to use it as dst on the send command
+  Mac48Address mac_dst;
+  mac_dst.CopyFrom(mac);
+
+  //if the device ix is not valid assertion fails
+  Ptr<NetDevice> dev = node->GetDevice(ifIx);
+  if(dev->IsLinkUp()) {
+    if(!dev->Send(pkt, mac_dst, 0x0800))
+      fprintf(stdout, "%03.6f: packet dropped...\n", getTsLong());
+  } else {
+    fprintf(stderr, "%03.6f: device %s.%d is not up yet\n", 
+        getTsLong(), Names::FindName(node).c_str(), ifIx);
+  }
 }
 
 CAMLprim value
-caml_pkt_write(value v_name, value v_ifIx, value v_ba, 
+caml_pkt_write(value v_node, value v_ifIx, value v_ba, 
     value v_off, value v_len) {
 
-  CAMLparam5(v_name, v_ifIx, v_ba, v_off, v_len);
+  CAMLparam5(v_node, v_ifIx, v_ba, v_off, v_len);
   
   uint32_t ifIx = (uint32_t)Int_val(v_ifIx);
-  string name = string(String_val(v_name));
   int len = Int_val(v_len);
 
   //TODO: this appeared invalid on the openflow switch case
@@ -253,91 +349,156 @@ caml_pkt_write(value v_name, value v_ifIx, value v_ba,
   uint8_t *buf = (uint8_t *) Caml_ba_data_val(v_ba);
   Ptr< Packet> pkt = Create<Packet>(buf + off, len);
 
-  // find the right device for the node and send packet
-  Ptr<Node> node = nodes[name]->node;
+  send_packet(Int_val(v_node), ifIx, pkt, buf + off);
+  CAMLreturn( Val_unit );
+}
 
-  //find the dst mac to use it as dst on the send command
-  Mac48Address mac_dst;
-  mac_dst.CopyFrom(buf + off);
+// A header made of the leading fragments of a frame. Adding it to a
+// packet holding the last fragment copies each fragment once, straight
+// into the packet buffer.
+class GatherHeader : public Header {
+public:
+  vector<pair<const uint8_t *, uint32_t> > frags;
+
+  static TypeId GetTypeId (void) {
+    static TypeId tid = TypeId ("ns3::MirageGatherHeader")
+      .SetParent<Header> ()
+      .AddConstructor<GatherHeader> ();
+    return tid;
+  }
+  virtual TypeId GetInstanceTypeId (void) const { return GetTypeId (); }
+  virtual void Print (std::ostream &os) const {
+    os << "fragments=" << frags.size ();
+  }
+  virtual uint32_t GetSerializedSize (void) const {
+    uint32_t len = 0;
+    for (size_t i = 0; i < frags.size (); i++)
+      len += frags[i].second;
+    return len;
+  }
+  virtual void Serialize (Buffer::Iterator start) const {
+    for (size_t i = 0; i < frags.size (); i++)
+      start.Write (frags[i].first, frags[i].second);
+  }
+  // only used to build outgoing packets
+  virtual uint32_t Deserialize (Buffer::Iterator start) { return 0; }
+};
 
-  //if the device ix is not valid assertion fails
-  Ptr<NetDevice> dev = node->GetDevice(ifIx);
-  if(dev->IsLinkUp()) {
-    if(!dev->Send(pkt, mac_dst, 0x0800))
-      fprintf(stdout, "%03.6f: packet dropped...\n", getTsLong());
-  } else {
-    fprintf(stderr, "%03.6f: device %s.%d is not up yet\n", 
-        getTsLong(), name.c_str(), ifIx);
+// Send the frame made of v_frags, a list of Cstruct.t, without
+// gathering it in an intermediate buffer first
+CAMLprim value
+caml_pkt_writev(value v_node, value v_ifIx, value v_frags) {
+  CAMLparam3(v_node, v_ifIx, v_frags);
+  static GatherHeader hdr;
+  uint8_t mac[6];
+  uint32_t mac_len = 0;
+
+  hdr.frags.clear();
+  for (value l = v_frags; l != Val_emptylist; l = Field(l, 1)) {
+    value cs = Field(l, 0);
+    const uint8_t *p =
+      (const uint8_t *)Caml_ba_data_val(Field(cs, 0)) + Long_val(Field(cs, 1));
+    uint32_t len = Long_val(Field(cs, 2));
+    if (len == 0)
+      continue;
+    // the destination mac may span fragments
+    for (uint32_t i = 0; mac_len < 6 && i < len; i++)
+      mac[mac_len++] = p[i];
+    hdr.frags.push_back(make_pair(p, len));
   }
+  if (hdr.frags.empty() || mac_len < 6)
+    caml_invalid_argument("Netif.writev: frame too short");
+
+  // the last fragment, usually the payload, makes the packet and the
+  // others go in front of it
+  pair<const uint8_t *, uint32_t> last = hdr.frags.back();
+  hdr.frags.pop_back();
+  Ptr<Packet> pkt = Create<Packet>(last.first, last.second);
+  if (!hdr.frags.empty())
+    pkt->AddHeader(hdr);
+
+  send_packet(Int_val(v_node), (uint32_t)Int_val(v_ifIx), pkt, mac);
   CAMLreturn( Val_unit );
 }
 
 bool
-check_queue_size(string name, int ifIx) {
-  /* TODO: not sure how volatile is the default queue len */
-  const uint32_t queue_len = 100;
+check_queue_size(int node, int ifIx) {
   Ptr<PointToPointNetDevice> dev =
-    nodes[name]->node->GetDevice(ifIx)->GetObject<PointToPointNetDevice>();
-  Ptr<Queue> q = dev->GetQueue();
-  return (queue_len > q->GetNPackets());
+    node_table[node]->node->GetDevice(ifIx)->GetObject<PointToPointNetDevice>();
+  Ptr<MirageQueue> q = DynamicCast<MirageQueue>(dev->GetQueue());
+  if (q == 0)
+    return true;
+  return q->HasRoom();
 }
 
 /*  true -> queue is not full, false queue is full */
 CAMLprim value
-caml_queue_check(value v_name,  value v_id) {
-  CAMLparam2(v_name, v_id);
-  string name =  string(String_val(v_name));
+caml_queue_check(value v_node,  value v_id) {
+  CAMLparam2(v_node, v_id);
   int ifIx = Int_val(v_id);
-  if(check_queue_size(name, ifIx) )
+  if(check_queue_size(Int_val(v_node), ifIx) )
     CAMLreturn(Val_true);
   else
     CAMLreturn(Val_false);
 }
 
+// The MirageQueue of dev has drained to its low watermark
 static bool
 NetQueueUnblockHandler(Ptr<NetDevice> dev) {
-  string name = Names::FindName(dev->GetNode());
+  struct node_state *st = node_of_dev(dev);
   int ifIx = dev->GetIfIndex();
-//  if( nodes[name]->blocked_dev_mask[ifIx]) {
-    if(dev->GetObject<PointToPointNetDevice>()->GetQueue()->GetNPackets() 
-        > 95) {
-      nodes[name]->blocked_dev_mask[ifIx] = false;
+  if (st->blocked_dev_mask[ifIx]) {
+    st->blocked_dev_mask[ifIx] = false;
     caml_callback2(*ns3_cb->queue_unblock_cb,
-        caml_copy_string((const char *)name.c_str()),
-        Val_int(ifIx));
+        Val_int(st->node_id), Val_int(ifIx));
+    run_caml_threads();
   }
   return true;
 }
 
 CAMLprim value
-caml_register_check_queue(value v_name,  value v_id) {
-  CAMLparam2(v_name, v_id);
-  string name =  string(String_val(v_name));
+caml_register_check_queue(value v_node,  value v_id) {
+  CAMLparam2(v_node, v_id);
   int ifIx = Int_val(v_id);
-  nodes[name]->blocked_dev_mask[ifIx] = true;
+  node_table[Int_val(v_node)]->blocked_dev_mask[ifIx] = true;
 //  Simulator::Schedule(MicroSeconds(1), &NetQueueCheckHandler, name, ifIx);
   CAMLreturn(Val_unit);
 }
 
-Ptr<Node>
+// The ns-3 nodes and links are only created when the simulation starts:
+// the rank of a node is fixed when it is created, and the partitioner
+// needs the whole topology to choose it.
+void
 addNs3Node(string name) {
+  // add in the last hashmap and the handle tables
+  struct node_state *st = new node_state();
+  st->node_id = node_count;
+  node_count++;
+  st->name = name;
+  st->rank = 0;
+  st->blocked_dev_mask = NULL;
+  nodes[name] = st;
+  node_table.push_back(st);
+}
+
+static void
+createNs3Node(struct node_state *st) {
   // create a single node for the new host
   NodeContainer node;
 
 #if USE_MPI 
-  node.Create(1, node_count);
+  node.Create(1, st->rank);
 #else 
   node.Create(1);
 #endif
-  // add in the last hashmap
-  nodes[name] = new node_state();
-  nodes[name]->node_id = node_count;
-  node_count++;
-  nodes[name]->blocked_dev_mask = NULL;
-  nodes[name]->node = Ptr<Node>(node.Get(0));
-  Names::Add(name, node.Get(0));
-
-  return node.Get(0);
+  st->node = Ptr<Node>(node.Get(0));
+  if (node_of_ns3_id.size() <= st->node->GetId())
+    node_of_ns3_id.resize(st->node->GetId() + 1, NULL);
+  node_of_ns3_id[st->node->GetId()] = st;
+  Names::Add(st->name, node.Get(0));
+  // register handlers in case a new network device is added
+  // on the node
+  st->node->RegisterDeviceAdditionListener(MakeCallback(&DeviceHandler));
 }
 
 /*
@@ -348,66 +509,160 @@ ocaml_ns3_add_node(value v_name) {
   CAMLparam1( v_name );
   string name =  string(String_val(v_name));
   addNs3Node(name);
-  // register handlers in case a new network device is added
-  // on the node
-  nodes[name]->node->RegisterDeviceAdditionListener(MakeCallback(&DeviceHandler));
-  CAMLreturn( Val_unit );
+  CAMLreturn( Val_int(nodes[name]->node_id) );
 }
 
 CAMLprim value
 ocaml_ns3_add_link_bytecode(value * argv, int argn) {
   return ocaml_ns3_add_link_native(argv[0], argv[1], argv[2], argv[3],
-      argv[4], argv[5]);
+      argv[4], argv[5], argv[6], argv[7]);
+}
+
+// the transmit queues that run an AQM discipline, reported at the end
+// of the run
+struct aqm_queue {
+  Ptr<NetDevice> dev;
+  Ptr<MirageQueue> q;
+};
+vector<struct aqm_queue> aqm_queues;
+
+static void
+report_queue_stats() {
+  for (size_t i = 0; i < aqm_queues.size(); i++) {
+    Ptr<NetDevice> dev = aqm_queues[i].dev;
+    Ptr<MirageQueue> q = aqm_queues[i].q;
+    printf("queue %s.%d: %llu sent, sojourn avg %.6f max %.6f, "
+        "%llu overflow drops, %llu early drops\n",
+        Names::FindName(dev->GetNode()).c_str(), dev->GetIfIndex(),
+        (unsigned long long)q->GetSojournCount(),
+        q->GetAverageSojourn().GetSeconds(), q->GetMaxSojourn().GetSeconds(),
+        (unsigned long long)q->GetOverflowDrops(),
+        (unsigned long long)q->GetAqmDrops());
+  }
 }
 
 
+// Links are installed when the simulation starts, see addNs3Node. Their
+// index in links is the handle returned by add_link.
+struct link_state {
+  struct node_state *a, *b;
+  uint32_t rate;          // bps
+  int propagation;        // ns
+  int queue_size;         // packets
+  int queue_bytes;        // bytes, or 0 to count packets
+  int discipline;         // MirageQueue::QueueDiscipline
+  bool use_pcap;
+  struct link_end end[2]; // at a and b
+};
+vector<struct link_state *> links;
+
 CAMLprim value
 ocaml_ns3_add_link_native(value ocaml_node_a, value ocaml_node_b, value v_rate,
-    value v_prop_d, value v_queue_size, value v_pcap) {
+    value v_prop_d, value v_queue_size, value v_queue_bytes, value v_discipline,
+    value v_pcap) {
   CAMLparam5(ocaml_node_a, ocaml_node_b, v_rate, v_prop_d, v_queue_size);
-  CAMLxparam1(v_pcap);
-  string node_a = string(String_val(ocaml_node_a));
-  string node_b = string(String_val(ocaml_node_b));
-  uint32_t rate = ((uint32_t)Int_val(v_rate)) * 1048576;
-  int propagation = Int_val(v_prop_d);
-  int queue_size = Int_val(v_queue_size);
-  bool use_pcap = Bool_val(v_pcap);
-  
-  Ptr<MirageQueue> q;
+  CAMLxparam3(v_queue_bytes, v_discipline, v_pcap);
+  struct link_state *l = new link_state();
+  l->a = nodes[string(String_val(ocaml_node_a))];
+  l->b = nodes[string(String_val(ocaml_node_b))];
+  l->rate = ((uint32_t)Int_val(v_rate)) * 1048576;
+  l->propagation = Int_val(v_prop_d);
+  l->queue_size = Int_val(v_queue_size);
+  l->queue_bytes = Int_val(v_queue_bytes);
+  // Topology.queue_discipline has the order of MirageQueue::QueueDiscipline
+  l->discipline = Int_val(v_discipline);
+  l->use_pcap = Bool_val(v_pcap);
+  for (int i = 0; i < 2; i++) {
+    l->end[i].rx_packets = 0;
+    l->end[i].rx_bytes = 0;
+  }
+  links.push_back(l);
+  CAMLreturn ( Val_int(links.size() - 1) );
+}
 
-  // create a single node for the new host
-  NodeContainer cont = NodeContainer(nodes[node_a]->node,
-      nodes[node_b]->node);
+static void
+installLink(struct link_state &l) {
+  int discipline = l.discipline;
+
+  NodeContainer cont = NodeContainer(l.a->node, l.b->node);
   PointToPointHelper p2p;
 
   //configure the link properties and queue
-  p2p.SetDeviceAttribute("DataRate", DataRateValue (DataRate (rate)));
-  p2p.SetChannelAttribute("Delay", TimeValue(NanoSeconds(propagation)));
-/*   Ptr<MirageQueue> */ q = CreateObject<MirageQueue>();
-  q->SetAttribute("MaxPackets",  UintegerValue (queue_size));
-  p2p.SetDeviceAttribute("TxQueue", PointerValue(q));
+  p2p.SetDeviceAttribute("DataRate", DataRateValue (DataRate (l.rate)));
+  p2p.SetChannelAttribute("Delay", TimeValue(NanoSeconds(l.propagation)));
+  if (l.queue_bytes > 0)
+    p2p.SetQueue("ns3::MirageQueue",
+        "Mode", EnumValue (MirageQueue::QUEUE_MODE_BYTES),
+        "MaxBytes", UintegerValue (l.queue_bytes),
+        "Discipline", EnumValue (discipline));
+  else
+    p2p.SetQueue("ns3::MirageQueue", "MaxPackets", UintegerValue (l.queue_size),
+        "Discipline", EnumValue (discipline));
   NetDeviceContainer link = p2p.Install(cont);
 
-  //setup packet handler
+  //setup packet handler and writer flow control
   MirageQueue::QueueUnblockCallback cb = MakeCallback(&NetQueueUnblockHandler);
-  link.Get(0)->SetPromiscReceiveCallback(MakeCallback(&PktDemux));
-  q = CreateObject<MirageQueue>();
-  q->SetAttribute("MaxPackets",  UintegerValue (100));
-  q->SetUnblockCallback(cb, link.Get(0));
-  link.Get(0)->GetObject<PointToPointNetDevice>()->SetQueue(q->GetObject<Queue>());
-  link.Get(1)->SetPromiscReceiveCallback(MakeCallback(&PktDemux));
-  q = CreateObject<MirageQueue>();
-  q->SetAttribute("MaxPackets",  UintegerValue (100));
-  q->SetUnblockCallback(cb, link.Get(1));
-  link.Get(1)->GetObject<PointToPointNetDevice>()->SetQueue(q->GetObject<Queue>());
+  for (uint32_t i = 0; i < link.GetN(); i++) {
+    link.Get(i)->SetPromiscReceiveCallback(MakeCallback(&PktDemux));
+    Ptr<MirageQueue> q = DynamicCast<MirageQueue>(
+        link.Get(i)->GetObject<PointToPointNetDevice>()->GetQueue());
+    q->SetUnblockCallback(cb, link.Get(i));
+    l.end[i].q = q;
+    struct node_state *st = (i == 0) ? l.a : l.b;
+    uint32_t ifIx = link.Get(i)->GetIfIndex();
+    if (st->ends.size() <= ifIx)
+      st->ends.resize(ifIx + 1, NULL);
+    st->ends[ifIx] = &l.end[i];
+    if (discipline != MirageQueue::DISC_DROP_TAIL) {
+      struct aqm_queue aq = { link.Get(i), q };
+      aqm_queues.push_back(aq);
+    }
+  }
 
   //capture pcap trace
-  if (use_pcap) {
+  if (l.use_pcap) {
     p2p.EnablePcap("ns3", link.Get(0), true);
     p2p.EnablePcap("ns3", link.Get(1), true);
   }
+}
 
-  CAMLreturn ( Val_unit );
+// Assign the nodes to the MPI ranks, then create them and their links
+static void
+build_topology() {
+  uint32_t n_ranks = 1;
+  uint32_t self = 0;
+#if USE_MPI
+  n_ranks = MpiInterface::GetSize();
+  self = MpiInterface::GetSystemId();
+#endif
+
+  vector<struct partition_link> graph;
+  for (size_t i = 0; i < links.size(); i++) {
+    struct partition_link pl = { links[i]->a->node_id, links[i]->b->node_id,
+      (uint64_t)links[i]->propagation };
+    graph.push_back(pl);
+  }
+  vector<uint32_t> rank = partition_nodes(node_table.size(), graph, n_ranks);
+  for (size_t i = 0; i < node_table.size(); i++) {
+    node_table[i]->rank = rank[i];
+    createNs3Node(node_table[i]);
+  }
+  for (size_t i = 0; i < links.size(); i++)
+    installLink(*links[i]);
+
+  if (n_ranks > 1 && self == 0) {
+    int cut = 0;
+    for (size_t i = 0; i < graph.size(); i++)
+      if (rank[graph[i].a] != rank[graph[i].b])
+        cut++;
+    uint64_t lookahead = partition_lookahead(rank, graph);
+    if (cut)
+      printf("%d nodes on %d ranks: %d links cut, lookahead %llu ns\n",
+          (int)node_table.size(), n_ranks, cut, (unsigned long long)lookahead);
+    else
+      printf("%d nodes on %d ranks: no links cut\n",
+          (int)node_table.size(), n_ranks);
+  }
 }
 
 /*
@@ -476,121 +731,87 @@ ns3_init(void) {
 }
 
 static void
-call_init_method (string name) {
-  value ml_name;
-#if USE_MPI
-  if ((MpiInterface::GetSystemId ()) !=
-      nodes[name]->node_id)
-    return;
-#endif
-  caml_register_global_root(&ml_name);
-  ml_name = caml_alloc_string(name.size());
-  memcpy( String_val(ml_name), name.c_str(), name.size());
-  caml_callback(*(ns3_cb->init_cb), ml_name);
-  caml_remove_global_root(&ml_name);
+call_init_method (int node) {
+  caml_callback(*(ns3_cb->init_cb), Val_int(node));
+  run_caml_threads();
 }
 
 
 /*
- * A method to get network card counters
+ * Link statistics
  */
+// Copy the counters of every link into v_ba, an int64 bigarray, without
+// resetting them: LINK_STATS_FIELDS per end of each link, end a first,
+// in the order of Topology.link_counter. Returns the number of links
+// copied, which is limited by the size of v_ba.
+#define LINK_STATS_FIELDS 8
+
 CAMLprim value
-ocaml_ns3_get_dev_byte_counter(value node_a, value node_b) {
-  CAMLparam2(node_a, node_b);
-  int i, j;
-  int32_t bytes = -1;
-  string source_name = string(String_val(node_a));
-  string dst_name = string(String_val(node_b));
-  Ptr<Node> source = nodes[source_name]->node;
-
-  for (i = 0; i < source->GetNDevices(); i++) {
-    Ptr<PointToPointNetDevice> dev = 
-      source->GetDevice(i)->GetObject<PointToPointNetDevice>();
-    Ptr<Channel> ch = dev->GetChannel();
-    for (j = 0; j < ch->GetNDevices(); j++) {
-      Ptr<Node> dst = ch->GetDevice(j)->GetNode();
-      string dev_name = Names::FindName(dst);
-      if (dst_name == dev_name) {
-        Ptr<Queue> q = dev->GetQueue();
-        bytes = (q->GetTotalReceivedBytes()>>8) -
-          (q->GetTotalDroppedBytes()>>8) -
-          (q->GetNBytes()>>8);
-        q->ResetStatistics();
-        break;
+ocaml_ns3_link_stats(value v_ba) {
+  int64_t *out = (int64_t *)Caml_ba_data_val(v_ba);
+  size_t n = Caml_ba_array_val(v_ba)->dim[0] / (2 * LINK_STATS_FIELDS);
+  if (n > links.size())
+    n = links.size();
+
+  for (size_t i = 0; i < n; i++) {
+    for (int e = 0; e < 2; e++) {
+      struct link_end *end = &links[i]->end[e];
+      Ptr<MirageQueue> q = end->q;
+      if (q == 0) {
+        // before the simulation starts, or a device on another rank
+        memset(out, 0, LINK_STATS_FIELDS * sizeof(int64_t));
+      } else {
+        out[0] = q->GetSojournCount();
+        out[1] = q->GetTxBytes();
+        out[4] = q->GetOverflowDrops();
+        out[5] = q->GetAqmDrops();
+        out[6] = q->GetQueuedPackets();
+        out[7] = q->GetQueuedBytes();
       }
+      out[2] = end->rx_packets;
+      out[3] = end->rx_bytes;
+      out += LINK_STATS_FIELDS;
     }
   }
-  CAMLreturn(Val_int(bytes));
-
+  return Val_int(n);
 }
 
-int connect_socket (string server, int port) {
-  int sock;                        /* Socket descriptor */
-  struct sockaddr_in echoServAddr; /* Echo server address */
+/*
+ * Logging, see log_ring.h
+ */
+// Messages of the simulator itself, at level info and with no node
+void
+ns_log(char *msg) {
+  log_ring_append(Simulator::Now().GetNanoSeconds(), -1, 1, msg, strlen(msg));
+}
 
-  /* Create a reliable, stream socket using TCP */
-  if ((sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
-    perror("socket() error");
-    exit(1);
-  }
+CAMLprim value
+ocaml_ns3_log_open(value v_path, value v_size) {
+  CAMLparam2(v_path, v_size);
+  if (log_ring_open(String_val(v_path), Long_val(v_size)) < 0)
+    caml_failwith(strerror(errno));
+  CAMLreturn(Val_unit);
+}
 
-  /* Construct the server address structure */
-  memset(&echoServAddr, 0, sizeof(echoServAddr));     /* Zero out structure */
-  echoServAddr.sin_family      = AF_INET;             /* Internet address family */
-  echoServAddr.sin_addr.s_addr = inet_addr(server.c_str());   /* Server IP address */
-  echoServAddr.sin_port        = htons(port); /* Server port */
-
-
-//  int flag = 1;
-//  int result = setsockopt(sock,            /* socket affected */
-//      IPPROTO_TCP,     /* set option at TCP level */
-//      TCP_NODELAY,     /* name of option */
-//      (char *) &flag,  /* the cast is historical
-//                          cruft */
-//      sizeof(int));    /* length of option value */
-
-  /* Establish the connection to the echo server */
-  if (connect(sock, (struct sockaddr *) &echoServAddr, 
-        sizeof(echoServAddr)) < 0) {
-    return -1; 
-  }
-  return sock;
+// The message is copied into the ring before returning, so the writer
+// thread never looks at the OCaml heap.
+CAMLprim value
+ocaml_ns3_log_append(value v_level, value v_node, value v_msg) {
+  log_ring_append(Simulator::Now().GetNanoSeconds(), Int_val(v_node),
+      Int_val(v_level), String_val(v_msg), caml_string_length(v_msg));
+  return Val_unit;
 }
 
-int log_fd = -1;
-int debug = 0;
-string log_server = ""; 
-int log_port = 0; 
+CAMLprim value
+ocaml_ns3_log_flush(value v_unit) {
+  log_ring_flush();
+  return Val_unit;
+}
 
-void
-ns_log(char *msg) {
-  if (!debug) 
-    return; 
-  if (log_fd == -1) {
-    int sock = connect_socket(log_server, log_port);
-    if(sock <= 0) {
-      printf("[console] error opening socket\n");
-      return; 
-    }
-    log_fd = sock;
-  }
-  // print data
-  int32_t msglen = strlen(msg); /* Determine input length */
-  int32_t send_len = htonl(msglen);
-
-  /* Send the string to the server */
-  send(log_fd, &send_len, 4, 0);
-  int sending = 0; 
-  while ( sending < msglen) {
-    int ret = send(log_fd, (msg + sending), (msglen - sending), 0);
-    if (ret < 0) { 
-      perror("ns_log err");
-      close(log_fd);
-      log_fd = -1; 
-      break;
-    }
-    sending += ret; 
-  }
+CAMLprim value
+ocaml_ns3_log_close(value v_unit) {
+  log_ring_close();
+  return Val_unit;
 }
 
 CAMLprim value
@@ -602,23 +823,11 @@ ocaml_ns3_log(value v_msg) {
  
 // Main simulation run function
 CAMLprim value
-ocaml_ns3_run(value v_duration, value v_debug, value v_srv, value v_p) {
-  CAMLparam4(v_duration, v_debug, v_srv, v_p);
+ocaml_ns3_run(value v_duration) {
+  CAMLparam1(v_duration);
   int duration = Int_val(v_duration);
-  debug = Int_val(v_debug);
-  log_server =  string(String_val(v_srv));
-  log_port = (Int_val(v_p));
 
-#if USE_MPI
-  // for each host I need a signle process 
-  if (MpiInterface::GetSize() < nodes.size()) {
-    char msg[2048];
-    snprintf(msg, 2048, "Insufficient number of mpi processes. \
-        Need %d processes.", (int)nodes.size());
-    NS_FATAL_ERROR(msg);
-    exit(1);
-  }
-#endif
+  build_topology();
 
   // Configure the logging functionality
   // LogComponentEnable ("TapBridge", LOG_LEVEL_LOGIC);
@@ -637,21 +846,28 @@ ocaml_ns3_run(value v_duration, value v_debug, value v_srv, value v_p) {
   ns3_cb->init_cb = caml_named_value("init");
   ns3_cb->net_dev_cb = caml_named_value("plug_dev");
   ns3_cb->pkt_in_cb = caml_named_value("demux_pkt");
+  ns3_cb->rx_page_cb = caml_named_value("get_rx_page");
   ns3_cb->queue_unblock_cb = caml_named_value("unblock_device");
-
-  map<string, struct node_state* >::iterator it;
+  ns3_cb->iterate_cb = caml_named_value("main_iterate");
 
 /*  if ((MpiInterface::GetSystemId ()) == 0) {
     printf("sending topology to server\nXXXXXXX %s\n", topo);
     ns_log(topo); 
   } */
 
-  // on time 0 run the init code
-  for (it=nodes.begin() ; it != nodes.end(); it++) {
-   Simulator::Schedule(Seconds (0.0), &call_init_method, it->first);
+  // on time 0 run the init code of the nodes simulated by this rank
+  uint32_t self = 0;
+#if USE_MPI
+  self = MpiInterface::GetSystemId();
+#endif
+  for (size_t i = 0; i < node_table.size(); i++) {
+    if (node_table[i]->rank == self)
+      Simulator::Schedule(Seconds (0.0), &call_init_method, (int)i);
   }
 
   Simulator::Run ();
+  report_queue_stats();
+  log_ring_flush();
   Simulator::Destroy ();
 #if USE_MPI 
   MpiInterface::Disable ();
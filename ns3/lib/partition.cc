@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Greedy graph growing followed by boundary refinement, as in the
+ * initial partitioning phase of multilevel partitioners: ranks are
+ * grown one at a time from an unassigned node, always taking the node
+ * most strongly connected to the rank, and nodes are then moved to the
+ * neighbouring rank that they are more strongly connected to while the
+ * balance allows it.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <queue>
+#include <utility>
+#include <partition.h>
+
+// The weight of a link is the cost of cutting it. A link that is ten
+// times shorter than the longest one weighs about ten times more.
+static std::vector<uint64_t>
+link_weights(const std::vector<struct partition_link> &links) {
+  uint64_t max_delay = 1;
+  for (size_t i = 0; i < links.size(); i++)
+    if (links[i].delay > max_delay)
+      max_delay = links[i].delay;
+
+  std::vector<uint64_t> w(links.size());
+  for (size_t i = 0; i < links.size(); i++) {
+    uint64_t d = links[i].delay ? links[i].delay : 1;
+    uint64_t ratio = max_delay / d;
+    w[i] = 1 + (ratio > (1 << 20) ? (1 << 20) : ratio);
+  }
+  return w;
+}
+
+std::vector<uint32_t>
+partition_nodes(uint32_t n_nodes, const std::vector<struct partition_link> &links,
+    uint32_t n_ranks) {
+  const uint32_t none = (uint32_t)-1;
+  std::vector<uint32_t> rank(n_nodes, n_ranks > 1 ? none : 0);
+  if (n_ranks <= 1 || n_nodes == 0)
+    return rank;
+
+  // adjacency lists of (neighbour, weight)
+  std::vector<uint64_t> w = link_weights(links);
+  std::vector<std::vector<std::pair<uint32_t, uint64_t> > > adj(n_nodes);
+  for (size_t i = 0; i < links.size(); i++) {
+    if (links[i].a == links[i].b)
+      continue;
+    adj[links[i].a].push_back(std::make_pair(links[i].b, w[i]));
+    adj[links[i].b].push_back(std::make_pair(links[i].a, w[i]));
+  }
+
+  // grow the ranks, each to its share of the remaining nodes
+  uint32_t next_seed = 0, assigned = 0;
+  for (uint32_t r = 0; r < n_ranks && assigned < n_nodes; r++) {
+    uint32_t target = (n_nodes - assigned + (n_ranks - r) - 1) / (n_ranks - r);
+    std::vector<uint64_t> conn(n_nodes, 0);
+    std::priority_queue<std::pair<uint64_t, uint32_t> > frontier;
+    uint32_t size = 0;
+
+    while (size < target) {
+      uint32_t n = none;
+      while (!frontier.empty()) {
+        std::pair<uint64_t, uint32_t> top = frontier.top();
+        frontier.pop();
+        // skip assigned nodes and stale entries
+        if (rank[top.second] == none && top.first == conn[top.second]) {
+          n = top.second;
+          break;
+        }
+      }
+      if (n == none) {
+        // a new component, or the first node of the rank
+        while (rank[next_seed] != none)
+          next_seed++;
+        n = next_seed;
+      }
+      rank[n] = r;
+      size++;
+      assigned++;
+      for (size_t i = 0; i < adj[n].size(); i++) {
+        uint32_t m = adj[n][i].first;
+        if (rank[m] == none) {
+          conn[m] += adj[n][i].second;
+          frontier.push(std::make_pair(conn[m], m));
+        }
+      }
+    }
+  }
+
+  // refinement: move boundary nodes to the rank they are most connected
+  // to, if that lowers the cut and keeps every rank within 5% (and at
+  // least one node) of its share
+  std::vector<uint32_t> size(n_ranks, 0);
+  for (uint32_t n = 0; n < n_nodes; n++)
+    size[rank[n]]++;
+  uint32_t share = (n_nodes + n_ranks - 1) / n_ranks;
+  uint32_t slack = share / 20 + 1;
+
+  std::vector<uint64_t> to(n_ranks, 0);
+  for (int pass = 0; pass < 8; pass++) {
+    bool moved = false;
+    for (uint32_t n = 0; n < n_nodes; n++) {
+      uint32_t from = rank[n];
+      for (size_t i = 0; i < adj[n].size(); i++)
+        to[rank[adj[n][i].first]] += adj[n][i].second;
+
+      uint32_t best = from;
+      for (size_t i = 0; i < adj[n].size(); i++) {
+        uint32_t r = rank[adj[n][i].first];
+        if (to[r] > to[best] && size[r] + 1 <= share + slack &&
+            size[from] > 1 && size[from] - 1 + slack >= share)
+          best = r;
+      }
+      for (size_t i = 0; i < adj[n].size(); i++)
+        to[rank[adj[n][i].first]] = 0;
+      to[from] = 0;
+
+      if (best != from) {
+        rank[n] = best;
+        size[from]--;
+        size[best]++;
+        moved = true;
+      }
+    }
+    if (!moved)
+      break;
+  }
+  return rank;
+}
+
+uint64_t
+partition_lookahead(const std::vector<uint32_t> &rank,
+    const std::vector<struct partition_link> &links) {
+  uint64_t lookahead = UINT64_MAX;
+  for (size_t i = 0; i < links.size(); i++)
+    if (rank[links[i].a] != rank[links[i].b] && links[i].delay < lookahead)
+      lookahead = links[i].delay;
+  return lookahead;
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Assignment of simulated nodes to the ranks of a distributed (MPI)
+ * simulation. Every link between two ranks costs a message per packet
+ * and bounds the lookahead of the conservative synchronisation to its
+ * propagation delay, so the partitioner keeps links with short delays
+ * inside a rank and cuts long ones, while giving each rank about the
+ * same number of nodes.
+ */
+
+#ifndef MIRAGE_PARTITION_H
+#define MIRAGE_PARTITION_H
+
+#include <stdint.h>
+#include <vector>
+
+struct partition_link {
+  uint32_t a, b;        /* node handles */
+  uint64_t delay;       /* propagation delay in ns */
+};
+
+/* The rank of every node, by node handle. */
+std::vector<uint32_t>
+partition_nodes(uint32_t n_nodes, const std::vector<struct partition_link> &links,
+    uint32_t n_ranks);
+
+/* The smallest delay of the links cut by a partition, or UINT64_MAX if
+   no link is cut. */
+uint64_t
+partition_lookahead(const std::vector<uint32_t> &rank,
+    const std::vector<struct partition_link> &links);
+
+#endif /* MIRAGE_PARTITION_H */
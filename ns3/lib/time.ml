@@ -29,27 +29,81 @@ open Lwt
    | Sleepers                                                        |
    +-----------------------------------------------------------------+ *)
 
-external ns3_add_timer_event : float -> int -> unit = "ocaml_ns3_add_timer_event"
+external ns3_add_timer_event : int -> int -> unit = "ocaml_ns3_add_timer_event"
+external ns3_del_timer_event : int -> unit = "ocaml_ns3_del_timer_event"
+
+(* The simulator clock ticks in microseconds, so all the sleepers whose
+   deadline falls in the same tick share one ns-3 event. Events are
+   identified by small integers that are reused once the event has fired
+   or has been cancelled, so both sides can keep them in plain arrays. *)
 
 type sleep = {
-  time : float;
-  id : int;
   mutable canceled : bool;
   thread : unit Lwt.u;
 }
 
-let count = ref 0
-let sleeping_threads = (Hashtbl.create 64)
+type event = {
+  tick : int;
+  mutable sleepers : sleep list;   (* most recent first *)
+  mutable live : int;              (* sleepers not cancelled yet *)
+}
+
+let events : event option array ref = ref (Array.make 64 None)
+let free_ids = Stack.create ()
+let next_id = ref 0
+let by_tick : (int, int) Hashtbl.t = Hashtbl.create 64
+
+let alloc_id () =
+  if not (Stack.is_empty free_ids) then Stack.pop free_ids else begin
+    let id = !next_id in
+    incr next_id;
+    if id >= Array.length !events then begin
+      let a = Array.make (2 * id) None in
+      Array.blit !events 0 a 0 id;
+      events := a
+    end;
+    id
+  end
+
+let release id ev =
+  !events.(id) <- None;
+  Hashtbl.remove by_tick ev.tick;
+  Stack.push id free_ids
+
+let now_tick () = int_of_float (Clock.time () *. 1e6 +. 0.5)
 
 let sleep d =
   let (res, w) = Lwt.task () in
-  let t = if d <= 0. then 0. else Clock.time () +. d in
-  let id = (!count) in
-  count := (!count) + 1;
-  let sleeper = { time = t; canceled = false; thread = w; id; } in 
-  Hashtbl.replace sleeping_threads id sleeper;
-  let _ = ns3_add_timer_event d id in 
-  Lwt.on_cancel res (fun _ -> sleeper.canceled <- true);
+  let now = now_tick () in
+  let tick = if d <= 0. then now else now + int_of_float (d *. 1e6) in
+  let sleeper = { canceled = false; thread = w } in
+  let id, ev =
+    try
+      let id = Hashtbl.find by_tick tick in
+      match !events.(id) with
+      | Some ev -> id, ev
+      | None -> raise Not_found
+    with Not_found ->
+      let id = alloc_id () in
+      let ev = { tick; sleepers = []; live = 0 } in
+      !events.(id) <- Some ev;
+      Hashtbl.replace by_tick tick id;
+      ns3_add_timer_event (tick - now) id;
+      id, ev
+  in
+  ev.sleepers <- sleeper :: ev.sleepers;
+  ev.live <- ev.live + 1;
+  Lwt.on_cancel res (fun () ->
+    if not sleeper.canceled then begin
+      sleeper.canceled <- true;
+      ev.live <- ev.live - 1;
+      (* nobody is left to wake up, so the simulator can drop the event *)
+      match !events.(id) with
+      | Some e when e == ev && ev.live = 0 ->
+        ns3_del_timer_event id;
+        release id ev
+      | _ -> ()
+    end);
   res
 
 let yield () = sleep 0.
@@ -71,18 +125,16 @@ let timeout d = sleep d >> Lwt.fail Timeout
 let with_timeout d f = Lwt.pick [timeout d; Lwt.apply f ()]
 
 let wakeup_thread id =
-  let thread = Hashtbl.find sleeping_threads id in 
-  let _ = 
-    match thread with 
-      |  { canceled = true } -> 
-          Hashtbl.remove sleeping_threads id
-      |  { thread = thread } -> 
-          Lwt.wakeup thread ();
-          Hashtbl.remove sleeping_threads id
-  in
-  let _ = Lwt.wakeup_paused () in 
-(*  let _= Lwt.wakeup_all () in *)
-    () 
+  match !events.(id) with
+  | None -> ()
+  | Some ev ->
+    release id ev;
+    List.iter (fun s ->
+        if not s.canceled then begin
+          s.canceled <- true;
+          Lwt.wakeup s.thread ()
+        end)
+      (List.rev ev.sleepers)
 
 let _ = Callback.register "timer_wakeup" wakeup_thread
 
@@ -17,27 +17,35 @@
 open Lwt
 open Printf 
 
-external ns3_add_node : string -> unit = "ocaml_ns3_add_node"
-external ns3_add_link : string -> string -> int -> int -> int -> bool -> unit 
+external ns3_add_node : string -> int = "ocaml_ns3_add_node"
+type queue_discipline = Drop_tail | Red | Codel | Fq_codel
+
+external ns3_add_link : string -> string -> int -> int -> int -> int ->
+  queue_discipline -> bool -> int
 = "ocaml_ns3_add_link_bytecode" "ocaml_ns3_add_link_native"
 (* external ns3_add_net_intf : string -> string -> string -> string -> unit =
   * "ns3_add_net_intf" *)
-external ns3_get_dev_byte_counter : string -> string -> int = 
-  "ocaml_ns3_get_dev_byte_counter"
+external ns3_link_stats : (int64, Bigarray.int64_elt, Bigarray.c_layout)
+  Bigarray.Array1.t -> int = "ocaml_ns3_link_stats"
 (* Main run thread *) 
-external ns3_run : int -> int ->  string -> int -> unit = "ocaml_ns3_run" 
+external ns3_run : int -> unit = "ocaml_ns3_run"
 
 type node_t = {
   name: string;
+  handle: int;
   cb_init : (unit -> unit Lwt.t);
 }
 
 type topo_t = {
   nodes : (string, node_t) Hashtbl.t;
-  mutable links : (string * string * float) list;
+  mutable by_handle : node_t array; (* the first [count] are in use *)
+  mutable count : int;
+  mutable links : (string * string) array; (* by link handle *)
+  mutable link_count : int;
 } 
 
-let topo = {nodes=(Hashtbl.create 64);links=[];}
+let topo = {nodes=(Hashtbl.create 64);by_handle=[||];count=0;links=[||];
+            link_count=0;}
 
 let exec fn () = Lwt.ignore_result (fn ())
  
@@ -67,49 +75,6 @@ let exec fn () = Lwt.ignore_result (fn ())
       Json.Object [("nodes",(Json.Array nodes));
       ("links", (Json.Array links));] *)
 
-(* let get_link_utilization () = 
-  let utilisation = List.fold_right (
-    fun (node_a, node_b, rate) r -> 
-      let utilization_a_b = 
-        (float_of_int ((ns3_get_dev_byte_counter node_a node_b) lsl 11)) *. 2.0 in
-      let res = r @ (
-        if (utilization_a_b < 0.0) then
-          []
-        else
-         [(Json.Object [
-          ("source", (Json.String node_a));
-          ("target", (Json.String node_b));
-          ("ts", (Json.Float (Clock.time ()) ));
-          ("value", (Json.Float (utilization_a_b /. rate)))])])
-      in
-      let utilization_b_a = 
-        float_of_int ((ns3_get_dev_byte_counter node_b node_a) lsl 11) in 
-        if (utilization_b_a < 0.0) then
-          res
-        else
-          res @ [
-            (Json.Object [
-              ("source", (Json.String node_b));
-              ("target", (Json.String node_a));
-              ("ts", (Json.Float (Clock.time ()) ));
-              ("value", (Json.Float (utilization_b_a /. rate) ))]);]
-  ) topo.links [] in 
-        Json.to_string (Json.Array utilisation) *)
-
-(* let monitor_links () =                                                
-  let _ = printf "starting link monitoring\n%!" in               
-  while_lwt true do                                         
-    lwt _ = Time.sleep 0.5 in            
-    let res = get_link_utilization () in                                
-(*    let msg = Json.to_string (
-      Json.Object [
-        ("ts", (Json.Float (Clock.time ())));
-        ("type", (Json.String "link_utilization"));
-        ("data", (Json.String res));]) in *)
-(*      let _ = Console.broadcast "link_utilization" res in *)
-     return ()                                                      
-  done    *)
-
 let load ?(debug=None) t =
   let _ = t () in
 (*  let msg =  Json.to_string (get_topology ()) in 
@@ -118,18 +83,28 @@ let load ?(debug=None) t =
       ("ts", (Json.Float (Clock.time ())));
       ("type", (Json.String "topology"));
     ("data", (Json.String msg));]) in *)
- (* let _ =
-    if (debug <> None) then
-      ignore_result (monitor_links ()) 
-in *)
 (*  match (debug) with 
   | None -> ns3_run (Time.get_duration ()) msg 0 "" 0 
   | Some(srv, p) ->  ns3_run (Time.get_duration ()) msg 1 srv p *)
-ns3_run (Time.get_duration ()) 0 "" 0 
+ns3_run (Time.get_duration ())
 
 let add_node name cb_init =
-  let _ = ns3_add_node name in
-    Hashtbl.replace topo.nodes name {name; cb_init;} 
+  let handle = ns3_add_node name in
+  let node = {name; handle; cb_init;} in
+  (* handles are given out in sequence *)
+  assert (handle = topo.count);
+  if topo.count = Array.length topo.by_handle then begin
+    let a = Array.make (2 * topo.count + 1) node in
+    Array.blit topo.by_handle 0 a 0 topo.count;
+    topo.by_handle <- a
+  end;
+  topo.by_handle.(handle) <- node;
+  topo.count <- topo.count + 1;
+  Hashtbl.replace topo.nodes name node
+
+let name_of_handle handle =
+  if handle < topo.count then topo.by_handle.(handle).name
+  else string_of_int handle
 
 let no_act_init () =
   return ()
@@ -148,25 +123,72 @@ let add_external_dev dev node ip mask =
 *)
 
 (* rate is in Mbps. *)
-let add_link ?(rate=1000) ?(prop_delay=0) ?(queue_size=100) ?(pcap=false)
-    node_a node_b =
+let add_link ?(rate=1000) ?(prop_delay=0) ?(queue_size=100) ?queue_bytes
+    ?(discipline=Drop_tail) ?(pcap=false) node_a node_b =
+  let queue_bytes = match queue_bytes with
+    | None -> 0
+    | Some b when b > 0 -> b
+    | Some _ -> invalid_arg "Topology.add_link: queue_bytes" in
   try 
     let _ = Hashtbl.find topo.nodes node_a in 
     let _ = Hashtbl.find topo.nodes node_b in 
-    let _ = topo.links <- (node_a, node_b, (float_of_int (rate * 1048576))) :: topo.links in 
-      ns3_add_link node_a node_b rate prop_delay queue_size pcap  
+    let handle =
+      ns3_add_link node_a node_b rate prop_delay queue_size queue_bytes
+        discipline pcap in
+    (* handles are given out in sequence *)
+    assert (handle = topo.link_count);
+    if topo.link_count = Array.length topo.links then begin
+      let a = Array.make (2 * topo.link_count + 1) (node_a, node_b) in
+      Array.blit topo.links 0 a 0 topo.link_count;
+      topo.links <- a
+    end;
+    topo.links.(handle) <- (node_a, node_b);
+    topo.link_count <- topo.link_count + 1
   with Not_found -> ()
 
+type link_counter =
+  | Tx_packets | Tx_bytes | Rx_packets | Rx_bytes
+  | Drops | Early_drops | Queue_packets | Queue_bytes
+
+type link_stats = (int64, Bigarray.int64_elt, Bigarray.c_layout) Bigarray.Array1.t
+
+(* must match LINK_STATS_FIELDS in ns_stubs.cc *)
+let link_fields = 8
+
+let link_count () = topo.link_count
+
+let link_nodes handle =
+  if handle < topo.link_count then topo.links.(handle)
+  else invalid_arg "Topology.link_nodes"
+
+let create_link_stats () =
+  let stats = Bigarray.(Array1.create int64 c_layout
+                          (max 1 (topo.link_count * 2 * link_fields))) in
+  Bigarray.Array1.fill stats 0L;
+  stats
+
+let snapshot_link_stats stats = ns3_link_stats stats
+
+let field = function
+  | Tx_packets -> 0 | Tx_bytes -> 1 | Rx_packets -> 2 | Rx_bytes -> 3
+  | Drops -> 4 | Early_drops -> 5 | Queue_packets -> 6 | Queue_bytes -> 7
+
+let link_counter stats handle ~at_a counter =
+  let end_ = if at_a then 0 else 1 in
+  Bigarray.Array1.get stats ((handle * 2 + end_) * link_fields + field counter)
+
 let node_name = Lwt.new_key ()
+let node_handle = Log.node_handle
 
 
-let init_node name =
-  let _ = Printf.printf "Initialising node %s....\n%!" name in
-    try
-      let node = Hashtbl.find topo.nodes name in 
-        Lwt.with_value node_name (Some(node.name)) (exec node.cb_init)
-    with Not_found -> 
-      printf "Node '%s' (len %d) was ot found\n%!" name (String.length name)
+let init_node handle =
+  if handle < topo.count then begin
+    let node = topo.by_handle.(handle) in
+    Log.info ~node:handle "Initialising node %s...." node.name;
+      Lwt.with_value node_name (Some(node.name)) (fun () ->
+        Lwt.with_value node_handle (Some(handle)) (exec node.cb_init))
+  end else
+    Log.error "Node %d was not found" handle
 
 
 let _ = Callback.register "init" init_node
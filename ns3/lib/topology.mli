@@ -16,9 +16,67 @@
 
 val node_name: string Lwt.key
 
+val node_handle: int Lwt.key
+(** [node_handle] is the handle of the node that runs the current
+    thread. Nodes are numbered densely from 0 in the order they are
+    added, and the simulator stubs refer to them by handle. *)
+
+val name_of_handle: int -> string
+(** [name_of_handle h] is the name of the node with handle [h]. *)
+
 val load: ?debug:(string * int) option -> (unit -> unit) -> unit
 
 val add_node: string -> (unit -> unit Lwt.t) -> unit
+type queue_discipline =
+  | Drop_tail  (** drop arriving packets when the queue is full *)
+  | Red        (** Random Early Detection *)
+  | Codel      (** CoDel, controlling the queue delay (RFC 8289) *)
+  | Fq_codel   (** CoDel on per-flow queues served in turn (RFC 8290) *)
+(** The management discipline of the transmit queues of a link. The
+    early drops and queue delays of the links that do not use
+    [Drop_tail] are reported when the simulation ends. *)
+
 val add_link: ?rate:int -> ?prop_delay:int -> 
-  ?queue_size:int -> ?pcap:bool -> string -> string -> unit
+  ?queue_size:int -> ?queue_bytes:int -> ?discipline:queue_discipline ->
+  ?pcap:bool -> string -> string -> unit
+(** [add_link a b] connects nodes [a] and [b]. Links are given handles
+    densely from 0 in the order they are added. The transmit queues hold
+    [queue_size] packets, or [queue_bytes] bytes if it is given (more
+    than a full frame, or writers are always blocked).
+    @raise Invalid_argument if [queue_bytes] is not positive. *)
+
+val link_count: unit -> int
+(** [link_count ()] is the number of links added so far. *)
+
+val link_nodes: int -> string * string
+(** [link_nodes h] is the pair of nodes that link [h] connects. *)
+
+type link_counter =
+  | Tx_packets     (** packets sent by this end *)
+  | Tx_bytes       (** bytes sent, including the 2-byte PPP header *)
+  | Rx_packets     (** packets received by this end *)
+  | Rx_bytes       (** bytes received *)
+  | Drops          (** packets dropped because the transmit queue was full *)
+  | Early_drops    (** packets dropped by the queue discipline *)
+  | Queue_packets  (** packets waiting in the transmit queue *)
+  | Queue_bytes    (** bytes waiting in the transmit queue *)
+(** The counters kept at each end of a link. They count from the start
+    of the simulation and are never reset. *)
+
+type link_stats
+(** A buffer holding the counters of every link. *)
+
+val create_link_stats: unit -> link_stats
+(** [create_link_stats ()] is a zeroed buffer large enough for the links
+    added so far. *)
+
+val snapshot_link_stats: link_stats -> int
+(** [snapshot_link_stats s] copies the current counters of every link
+    into [s], in one call and without allocating, and returns the number
+    of links copied. *)
+
+val link_counter: link_stats -> int -> at_a:bool -> link_counter -> int64
+(** [link_counter s h ~at_a c] is counter [c] of the end of link [h] at
+    its first node if [at_a], at its second node otherwise, as of the
+    last snapshot into [s]. *)
 (* val add_external_dev: string -> string -> string -> string -> unit *)
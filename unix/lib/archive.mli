@@ -0,0 +1,60 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+(** Read-only archives of named files, such as static assets or
+    configuration, that are served straight from memory. An archive
+    holds a hash table of the names, so a file is found in constant
+    time, and is returned as a view of the archive, without a copy.
+
+    On Xen, an archive can be passed as the boot module of the domain
+    and opened with:
+    {[ match Start_info.boot_module () with
+       | Some m -> Some (Archive.of_cstruct m)
+       | None -> None ]}
+
+    The format is, with every number a little-endian 32-bit integer and
+    every offset from the start of the archive:
+    - the magic ["MIRARCH1"], the number of files [n] and the number of
+      slots [s] of the hash table, a power of two larger than [n];
+    - the hash table: [s] slots holding [0] for an empty slot, or [i+1]
+      for the file [i]; the slot of a name is found by linear probing
+      from the FNV-1a hash of the name, modulo [2^30] and then [s];
+    - [n] file entries, each being the offset and length of the name,
+      and the offset and length of the contents;
+    - the names and contents, the latter aligned on 8 bytes. *)
+
+type t
+
+val of_cstruct : Cstruct.t -> t
+(** [of_cstruct buf] is the archive at the start of [buf]. Only its
+    header is checked; a file whose entry points out of [buf] raises
+    [Invalid_argument] when it is accessed.
+    @raise Invalid_argument if [buf] does not start with an archive. *)
+
+val length : t -> int
+(** [length a] is the number of files in [a]. *)
+
+val find : t -> string -> Cstruct.t option
+(** [find a name] is the contents of the file [name] of [a], if there
+    is one. *)
+
+val iter : (string -> Cstruct.t -> unit) -> t -> unit
+(** [iter f a] calls [f name contents] on every file of [a], in the
+    order they were given to {!build}. *)
+
+val build : (string * Cstruct.t) list -> Cstruct.t
+(** [build files] is a new archive holding [files].
+    @raise Invalid_argument if two files have the same name. *)
@@ -0,0 +1,63 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+type buf = Cstruct.buffer
+
+(* Host-order accessors that ocamlopt inlines as a single load or
+   store; the bytes are swapped on little-endian hosts. *)
+external get16 : buf -> int -> int = "%caml_bigstring_get16"
+external get32 : buf -> int -> int32 = "%caml_bigstring_get32"
+external get64 : buf -> int -> int64 = "%caml_bigstring_get64"
+external set16 : buf -> int -> int -> unit = "%caml_bigstring_set16"
+external set32 : buf -> int -> int32 -> unit = "%caml_bigstring_set32"
+external set64 : buf -> int -> int64 -> unit = "%caml_bigstring_set64"
+external swap16 : int -> int = "%bswap16"
+external swap32 : int32 -> int32 = "%bswap_int32"
+external swap64 : int64 -> int64 = "%bswap_int64"
+
+let get_uint16 b off =
+  if Sys.big_endian then get16 b off else swap16 (get16 b off)
+
+let get_uint32 b off =
+  if Sys.big_endian then get32 b off else swap32 (get32 b off)
+
+let get_uint64 b off =
+  if Sys.big_endian then get64 b off else swap64 (get64 b off)
+
+let set_uint16 b off v =
+  set16 b off (if Sys.big_endian then v else swap16 v)
+
+let set_uint32 b off v =
+  set32 b off (if Sys.big_endian then v else swap32 v)
+
+let set_uint64 b off v =
+  set64 b off (if Sys.big_endian then v else swap64 v)
+
+(* [Int32.to_int] sign-extends, and an unsigned 32-bit value does not
+   fit in an int on a 32-bit platform, where we read it as two halves.
+   The mask is written so that 32-bit compilers accept it. *)
+let get_uint32_int b off =
+  if Sys.word_size = 64 then
+    Int32.to_int (get_uint32 b off) land (1 lsl 32 - 1)
+  else begin
+    if off < 0 || off > Bigarray.Array1.dim b - 4
+    then invalid_arg "index out of bounds";
+    let hi = get_uint16 b off and lo = get_uint16 b (off + 2) in
+    if hi > max_int lsr 16 then invalid_arg "Big_endian.get_uint32_int";
+    (hi lsl 16) lor lo
+  end
+
+let set_uint32_int b off v = set_uint32 b off (Int32.of_int v)
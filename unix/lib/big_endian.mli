@@ -0,0 +1,56 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+(** Network (big-endian) byte order accessors for the buffers under
+    Cstruct. Offsets are from the start of the buffer, not of a Cstruct
+    view, and are checked against its length.
+
+    The accessors are built on the bigstring primitives, which the
+    native compiler inlines as a single (possibly unaligned) load or
+    store, followed or preceded by a byte swap on little-endian hosts.
+    The [int32] and [int64] results are not boxed when they are used
+    at once, for instance by [Int32.to_int]. *)
+
+type buf = Cstruct.buffer
+
+val get_uint16 : buf -> int -> int
+(** [get_uint16 b off] is the unsigned 16-bit integer at [off].
+    @raise Invalid_argument if it is not within [b]. *)
+
+val get_uint32 : buf -> int -> int32
+(** [get_uint32 b off] is the 32-bit integer at [off]. *)
+
+val get_uint64 : buf -> int -> int64
+(** [get_uint64 b off] is the 64-bit integer at [off]. *)
+
+val set_uint16 : buf -> int -> int -> unit
+(** [set_uint16 b off v] stores the low 16 bits of [v] at [off]. *)
+
+val set_uint32 : buf -> int -> int32 -> unit
+(** [set_uint32 b off v] stores [v] at [off]. *)
+
+val set_uint64 : buf -> int -> int64 -> unit
+(** [set_uint64 b off v] stores [v] at [off]. *)
+
+val get_uint32_int : buf -> int -> int
+(** [get_uint32_int b off] is the unsigned 32-bit integer at [off], as
+    an int. Unlike {!get_uint32}, it does not allocate on 64-bit
+    platforms, which suits addresses and sequence numbers.
+    @raise Invalid_argument if the integer does not fit in an int, which
+    can only happen on 32-bit platforms. *)
+
+val set_uint32_int : buf -> int -> int -> unit
+(** [set_uint32_int b off v] stores the low 32 bits of [v] at [off]. *)
@@ -0,0 +1,54 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+(* The Unix backend runs on the standard OCaml runtime, whose sweeper
+   has no census hook. *)
+let available = false
+
+type status =
+  | Idle
+  | Requested
+  | Running
+  | Done
+
+type census = {
+  live_blocks : int;
+  live_words : int;
+  free_words : int;
+  garbage_words : int;
+  tag_blocks : int array;
+  tag_words : int array;
+  class_blocks : int array;
+  class_words : int array;
+  dump_bytes : int;
+  truncated : bool;
+}
+
+let start ?dump () =
+  match dump with
+  | Some b when Cstruct.len b < 8 -> invalid_arg "Census.start"
+  | Some _ | None -> ()
+
+let cancel () = ()
+let status () = Idle
+let result () = None
+
+let run ?dump () =
+  start ?dump ();
+  Lwt.fail (Failure "Census.run: not available on this backend")
+
+let print ?max_tags:_ _ =
+  print_endline "Heap census: not available on this backend"
@@ -0,0 +1,67 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+(** Digests and checksums computed directly over Cstruct buffers,
+    without copying them into OCaml strings first. The SHA extensions
+    and the SSE4.2 [crc32] instruction are used when the CPU has them. *)
+
+(** Incremental cryptographic digests. *)
+module type S = sig
+
+  type t
+  (** A hashing context. *)
+
+  val digest_size : int
+  (** [digest_size] is the size of a digest, in bytes. *)
+
+  val init : unit -> t
+  (** [init ()] is a fresh hashing context. *)
+
+  val update : t -> Cstruct.t -> unit
+  (** [update t buf] feeds the contents of [buf] into [t]. *)
+
+  val finalize : t -> string
+  (** [finalize t] is the digest of everything fed into [t] so far.
+      [t] is left untouched and can still be updated. *)
+
+  val digest : Cstruct.t -> string
+  (** [digest buf] is the digest of [buf]. *)
+
+  val digestv : Cstruct.t list -> string
+  (** [digestv bufs] is the digest of the concatenation of [bufs]. *)
+
+  val accelerated : bool
+  (** [accelerated] is [true] if the CPU instructions are used. *)
+end
+
+module Sha1 : S
+
+module Sha256 : S
+
+(** CRC32C (Castagnoli) checksums. *)
+module Crc32c : sig
+
+  val digest : ?crc:int32 -> Cstruct.t -> int32
+  (** [digest ?crc buf] is the CRC32C of [buf]. If [crc] is the CRC32C
+      of some preceding data, the result is the CRC32C of that data
+      followed by [buf]. *)
+
+  val digestv : ?crc:int32 -> Cstruct.t list -> int32
+  (** [digestv ?crc bufs] is the CRC32C of the concatenation of [bufs]. *)
+
+  val accelerated : bool
+  (** [accelerated] is [true] if the CPU instructions are used. *)
+end
@@ -0,0 +1,474 @@
+/*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* SHA-1, SHA-256 and CRC32C over bigarray slices. The block functions
+   use the SHA extensions and the SSE4.2 crc32 instruction when the CPU
+   advertises them, and portable C otherwise. The choice is made once,
+   on first use. Hash contexts live in OCaml strings, so the update
+   functions never allocate and can be declared "noalloc". */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <caml/mlvalues.h>
+#include <caml/memory.h>
+#include <caml/alloc.h>
+#include <caml/bigarray.h>
+
+#if defined(__x86_64__) && defined(__GNUC__) && (__GNUC__ >= 5)
+#define HAVE_SHA_NI 1
+#include <immintrin.h>
+#endif
+
+struct sha_ctx {
+  uint32_t h[8];
+  uint64_t len;       /* total bytes hashed so far */
+  uint8_t buf[64];    /* partial block */
+};
+
+typedef void (*sha_blocks_fn)(uint32_t *h, const uint8_t *p, size_t nblocks);
+
+static inline uint32_t rol32(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+static inline uint32_t ror32(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+static inline uint32_t load_be32(const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void store_be32(uint8_t *p, uint32_t x)
+{
+  p[0] = x >> 24; p[1] = x >> 16; p[2] = x >> 8; p[3] = x;
+}
+
+/*
+ * CPU feature detection
+ */
+
+#define HW_SSE42  1
+#define HW_SHA    2
+
+static int hw_features = -1;
+
+static int
+get_hw_features(void)
+{
+  if (hw_features < 0) {
+    hw_features = 0;
+#if defined(__x86_64__)
+    uint32_t a, b, c, d;
+    __asm__ __volatile__ ("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (0), "c" (0));
+    uint32_t max_leaf = a;
+    __asm__ __volatile__ ("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (1), "c" (0));
+    int ssse3 = (c >> 9) & 1, sse41 = (c >> 19) & 1;
+    if ((c >> 20) & 1)
+      hw_features |= HW_SSE42;
+    if (max_leaf >= 7) {
+      __asm__ __volatile__ ("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (7), "c" (0));
+      if (((b >> 29) & 1) && ssse3 && sse41)
+        hw_features |= HW_SHA;
+    }
+#endif
+  }
+  return hw_features;
+}
+
+/*
+ * SHA-1
+ */
+
+static const uint32_t sha1_iv[5] = {
+  0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+};
+
+static void
+sha1_blocks_c(uint32_t *h, const uint8_t *p, size_t nblocks)
+{
+  uint32_t w[80];
+  int i;
+  while (nblocks--) {
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], t;
+    for (i = 0; i < 16; i++)
+      w[i] = load_be32(p + 4 * i);
+    for (; i < 80; i++)
+      w[i] = rol32(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+    for (i = 0; i < 80; i++) {
+      if (i < 20)
+        t = ((b & c) | (~b & d)) + 0x5a827999;
+      else if (i < 40)
+        t = (b ^ c ^ d) + 0x6ed9eba1;
+      else if (i < 60)
+        t = ((b & c) | (b & d) | (c & d)) + 0x8f1bbcdc;
+      else
+        t = (b ^ c ^ d) + 0xca62c1d6;
+      t += rol32(a, 5) + e + w[i];
+      e = d; d = c; c = rol32(b, 30); b = a; a = t;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    p += 64;
+  }
+}
+
+#ifdef HAVE_SHA_NI
+/* Four rounds per sha1rnds4, alternating between e0 and e1 for the
+   next value of E. The message schedule for group g+1 is finished with
+   sha1msg1/xor/sha1msg2 while group g is hashed. The round function
+   selector must be an immediate, hence the macro. */
+#define SHA1_GROUP(g) do {                                              \
+    if ((g) < 4)                                                        \
+      w[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 16 * (g))), mask); \
+    if ((g) == 0) {                                                     \
+      e0 = _mm_add_epi32(e0, w[0]);                                     \
+      e1 = abcd;                                                        \
+      abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);                          \
+    } else if ((g) & 1) {                                               \
+      e1 = _mm_sha1nexte_epu32(e1, w[(g) & 3]);                         \
+      e0 = abcd;                                                        \
+      abcd = _mm_sha1rnds4_epu32(abcd, e1, (g) / 5);                    \
+    } else {                                                            \
+      e0 = _mm_sha1nexte_epu32(e0, w[(g) & 3]);                         \
+      e1 = abcd;                                                        \
+      abcd = _mm_sha1rnds4_epu32(abcd, e0, (g) / 5);                    \
+    }                                                                   \
+    if ((g) >= 1 && (g) <= 16)                                          \
+      w[((g) - 1) & 3] = _mm_sha1msg1_epu32(w[((g) - 1) & 3], w[(g) & 3]); \
+    if ((g) >= 2 && (g) <= 17)                                          \
+      w[((g) - 2) & 3] = _mm_xor_si128(w[((g) - 2) & 3], w[(g) & 3]);   \
+    if ((g) >= 3 && (g) <= 18)                                          \
+      w[((g) + 1) & 3] = _mm_sha1msg2_epu32(w[((g) + 1) & 3], w[(g) & 3]); \
+  } while (0)
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void
+sha1_blocks_shani(uint32_t *h, const uint8_t *p, size_t nblocks)
+{
+  const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+  __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)h), 0x1b);
+  __m128i e0 = _mm_set_epi32(h[4], 0, 0, 0);
+  __m128i e1 = _mm_setzero_si128();
+  __m128i abcd_save, e0_save, w[4];
+
+  while (nblocks--) {
+    abcd_save = abcd;
+    e0_save = e0;
+    SHA1_GROUP(0);  SHA1_GROUP(1);  SHA1_GROUP(2);  SHA1_GROUP(3);
+    SHA1_GROUP(4);  SHA1_GROUP(5);  SHA1_GROUP(6);  SHA1_GROUP(7);
+    SHA1_GROUP(8);  SHA1_GROUP(9);  SHA1_GROUP(10); SHA1_GROUP(11);
+    SHA1_GROUP(12); SHA1_GROUP(13); SHA1_GROUP(14); SHA1_GROUP(15);
+    SHA1_GROUP(16); SHA1_GROUP(17); SHA1_GROUP(18); SHA1_GROUP(19);
+    e0 = _mm_sha1nexte_epu32(e0, e0_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+    p += 64;
+  }
+  _mm_storeu_si128((__m128i *)h, _mm_shuffle_epi32(abcd, 0x1b));
+  h[4] = _mm_extract_epi32(e0, 3);
+}
+#endif
+
+/*
+ * SHA-256
+ */
+
+static const uint32_t sha256_iv[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static void
+sha256_blocks_c(uint32_t *h, const uint8_t *p, size_t nblocks)
+{
+  uint32_t w[64];
+  int i;
+  while (nblocks--) {
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+    uint32_t e = h[4], f = h[5], g = h[6], hh = h[7], t1, t2;
+    for (i = 0; i < 16; i++)
+      w[i] = load_be32(p + 4 * i);
+    for (; i < 64; i++) {
+      uint32_t s0 = ror32(w[i-15], 7) ^ ror32(w[i-15], 18) ^ (w[i-15] >> 3);
+      uint32_t s1 = ror32(w[i-2], 17) ^ ror32(w[i-2], 19) ^ (w[i-2] >> 10);
+      w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+    for (i = 0; i < 64; i++) {
+      t1 = hh + (ror32(e, 6) ^ ror32(e, 11) ^ ror32(e, 25)) +
+           ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+      t2 = (ror32(a, 2) ^ ror32(a, 13) ^ ror32(a, 22)) +
+           ((a & b) ^ (a & c) ^ (b & c));
+      hh = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+    h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+    p += 64;
+  }
+}
+
+#ifdef HAVE_SHA_NI
+/* The state is kept as ABEF/CDGH as sha256rnds2 expects, and each
+   iteration of the inner loop does four rounds, scheduling the message
+   words of group i with sha256msg1/sha256msg2. */
+__attribute__((target("sha,sse4.1,ssse3")))
+static void
+sha256_blocks_shani(uint32_t *h, const uint8_t *p, size_t nblocks)
+{
+  const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&h[0]), 0xb1);
+  __m128i st1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&h[4]), 0x1b);
+  __m128i st0 = _mm_alignr_epi8(tmp, st1, 8);
+  __m128i abef_save, cdgh_save, msg, w[4];
+  int i;
+  st1 = _mm_blend_epi16(st1, tmp, 0xf0);
+
+  while (nblocks--) {
+    abef_save = st0;
+    cdgh_save = st1;
+    for (i = 0; i < 16; i++) {
+      if (i < 4)
+        w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 16 * i)), mask);
+      else {
+        msg = _mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]);
+        msg = _mm_add_epi32(msg, _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+        w[i & 3] = _mm_sha256msg2_epu32(msg, w[(i + 3) & 3]);
+      }
+      msg = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i *)&sha256_k[4 * i]));
+      st1 = _mm_sha256rnds2_epu32(st1, st0, msg);
+      st0 = _mm_sha256rnds2_epu32(st0, st1, _mm_shuffle_epi32(msg, 0x0e));
+    }
+    st0 = _mm_add_epi32(st0, abef_save);
+    st1 = _mm_add_epi32(st1, cdgh_save);
+    p += 64;
+  }
+  tmp = _mm_shuffle_epi32(st0, 0x1b);
+  st1 = _mm_shuffle_epi32(st1, 0xb1);
+  _mm_storeu_si128((__m128i *)&h[0], _mm_blend_epi16(tmp, st1, 0xf0));
+  _mm_storeu_si128((__m128i *)&h[4], _mm_alignr_epi8(st1, tmp, 8));
+}
+#endif
+
+static sha_blocks_fn sha1_blocks = NULL;
+static sha_blocks_fn sha256_blocks = NULL;
+
+static void
+select_sha_blocks(void)
+{
+  sha1_blocks = sha1_blocks_c;
+  sha256_blocks = sha256_blocks_c;
+#ifdef HAVE_SHA_NI
+  if (get_hw_features() & HW_SHA) {
+    sha1_blocks = sha1_blocks_shani;
+    sha256_blocks = sha256_blocks_shani;
+  }
+#endif
+}
+
+/*
+ * Merkle-Damgard streaming shared by both hashes
+ */
+
+static void
+sha_update(struct sha_ctx *ctx, sha_blocks_fn blocks, const uint8_t *p, size_t len)
+{
+  size_t used = ctx->len & 63;
+  ctx->len += len;
+  if (used) {
+    size_t n = 64 - used;
+    if (len < n) {
+      memcpy(ctx->buf + used, p, len);
+      return;
+    }
+    memcpy(ctx->buf + used, p, n);
+    blocks(ctx->h, ctx->buf, 1);
+    p += n; len -= n;
+  }
+  if (len >= 64) {
+    blocks(ctx->h, p, len / 64);
+    p += len & ~(size_t)63;
+    len &= 63;
+  }
+  memcpy(ctx->buf, p, len);
+}
+
+static void
+sha_final(struct sha_ctx *ctx, sha_blocks_fn blocks, uint8_t *out, int nwords)
+{
+  uint64_t bits = ctx->len * 8;
+  size_t used = ctx->len & 63;
+  int i;
+  ctx->buf[used++] = 0x80;
+  if (used > 56) {
+    memset(ctx->buf + used, 0, 64 - used);
+    blocks(ctx->h, ctx->buf, 1);
+    used = 0;
+  }
+  memset(ctx->buf + used, 0, 56 - used);
+  store_be32(ctx->buf + 56, (uint32_t)(bits >> 32));
+  store_be32(ctx->buf + 60, (uint32_t)bits);
+  blocks(ctx->h, ctx->buf, 1);
+  for (i = 0; i < nwords; i++)
+    store_be32(out + 4 * i, ctx->h[i]);
+}
+
+#define Ctx_val(v) ((struct sha_ctx *) String_val(v))
+#define Slice_val(v_ba, v_ofs) ((const uint8_t *) Caml_ba_data_val(v_ba) + Long_val(v_ofs))
+
+static value
+sha_alloc_ctx(const uint32_t *iv, int nwords)
+{
+  value v_ctx = caml_alloc_string(sizeof(struct sha_ctx));
+  struct sha_ctx *ctx = Ctx_val(v_ctx);
+  if (sha1_blocks == NULL)
+    select_sha_blocks();
+  memset(ctx, 0, sizeof(struct sha_ctx));
+  memcpy(ctx->h, iv, nwords * sizeof(uint32_t));
+  return v_ctx;
+}
+
+static value
+sha_finish(value v_ctx, sha_blocks_fn blocks, int nwords)
+{
+  CAMLparam1(v_ctx);
+  CAMLlocal1(v_digest);
+  /* Finalise a copy, so that the context can still be updated */
+  struct sha_ctx ctx;
+  memcpy(&ctx, Ctx_val(v_ctx), sizeof(ctx));
+  v_digest = caml_alloc_string(4 * nwords);
+  sha_final(&ctx, blocks, (uint8_t *) String_val(v_digest), nwords);
+  CAMLreturn(v_digest);
+}
+
+CAMLprim value
+caml_hash_sha1_init(value v_unit)
+{
+  return sha_alloc_ctx(sha1_iv, 5);
+}
+
+CAMLprim value
+caml_hash_sha1_update(value v_ctx, value v_ba, value v_ofs, value v_len)
+{
+  sha_update(Ctx_val(v_ctx), sha1_blocks, Slice_val(v_ba, v_ofs), Long_val(v_len));
+  return Val_unit;
+}
+
+CAMLprim value
+caml_hash_sha1_final(value v_ctx)
+{
+  return sha_finish(v_ctx, sha1_blocks, 5);
+}
+
+CAMLprim value
+caml_hash_sha256_init(value v_unit)
+{
+  return sha_alloc_ctx(sha256_iv, 8);
+}
+
+CAMLprim value
+caml_hash_sha256_update(value v_ctx, value v_ba, value v_ofs, value v_len)
+{
+  sha_update(Ctx_val(v_ctx), sha256_blocks, Slice_val(v_ba, v_ofs), Long_val(v_len));
+  return Val_unit;
+}
+
+CAMLprim value
+caml_hash_sha256_final(value v_ctx)
+{
+  return sha_finish(v_ctx, sha256_blocks, 8);
+}
+
+CAMLprim value
+caml_hash_sha_accelerated(value v_unit)
+{
+  return Val_bool(get_hw_features() & HW_SHA);
+}
+
+/*
+ * CRC32C (Castagnoli, as used by iSCSI, ext4 and btrfs)
+ */
+
+static uint32_t crc32c_table[256];
+
+static uint32_t
+crc32c_c(uint32_t crc, const uint8_t *p, size_t len)
+{
+  if (crc32c_table[1] == 0) {
+    uint32_t i, j, c;
+    for (i = 0; i < 256; i++) {
+      c = i;
+      for (j = 0; j < 8; j++)
+        c = (c >> 1) ^ (0x82f63b78 & -(c & 1));
+      crc32c_table[i] = c;
+    }
+  }
+  while (len--)
+    crc = crc32c_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined(__x86_64__)
+static uint32_t
+crc32c_sse42(uint32_t crc, const uint8_t *p, size_t len)
+{
+  uint64_t c = crc, v;
+  while (len && ((uintptr_t)p & 7)) {
+    __asm__ ("crc32b %1, %k0" : "+r" (c) : "rm" (*p));
+    p++; len--;
+  }
+  while (len >= 8) {
+    memcpy(&v, p, 8);
+    __asm__ ("crc32q %1, %0" : "+r" (c) : "rm" (v));
+    p += 8; len -= 8;
+  }
+  while (len--) {
+    __asm__ ("crc32b %1, %k0" : "+r" (c) : "rm" (*p));
+    p++;
+  }
+  return (uint32_t)c;
+}
+#endif
+
+/* [crc] is the CRC of the data seen so far (0 for none), so that the
+   CRC of a buffer chain can be computed one fragment at a time. */
+CAMLprim value
+caml_hash_crc32c(value v_crc, value v_ba, value v_ofs, value v_len)
+{
+  uint32_t crc = ~(uint32_t)Int32_val(v_crc);
+  const uint8_t *p = Slice_val(v_ba, v_ofs);
+  size_t len = Long_val(v_len);
+#if defined(__x86_64__)
+  if (get_hw_features() & HW_SSE42)
+    crc = crc32c_sse42(crc, p, len);
+  else
+#endif
+    crc = crc32c_c(crc, p, len);
+  return caml_copy_int32((int32_t)~crc);
+}
+
+CAMLprim value
+caml_hash_crc32c_accelerated(value v_unit)
+{
+  return Val_bool(get_hw_features() & HW_SSE42);
+}
@@ -0,0 +1,42 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+(* The Unix backend runs on the standard OCaml runtime, which has no
+   allocation hooks. *)
+let available = false
+
+type site = {
+  samples : int;
+  major : int;
+  promoted : int;
+  survived : int;
+  live : int;
+  callstack : Printexc.raw_backtrace;
+}
+
+let start ?(rate=1e-4) () =
+  if not (rate > 0. && rate <= 1.) then invalid_arg "Memprof.start"
+
+let stop () = ()
+let reset () = ()
+let rate () = 0.
+let sites () = []
+let words _ = 0.
+
+let dump ?max_sites:_ () =
+  print_endline "Allocation profile: not available on this backend"
+
+let to_cstruct _ = 0
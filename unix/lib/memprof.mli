@@ -0,0 +1,80 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+(** Statistical allocation profiler.
+
+    While the profiler runs, allocated words are sampled at random at a
+    fixed rate. The call stack of each sampled allocation is recorded,
+    and samples with the same call stack are counted together in a
+    site. A site also counts how many of its sampled blocks were promoted
+    out of the minor heap and how many survived a major collection. The
+    sampled blocks are not kept alive.
+
+    Allocations made by OCaml code in the minor heap are sampled, as are
+    all allocations in the major heap. Small allocations made by C stubs
+    are not sampled. Call stacks are 16 frames deep at most. They can
+    only be printed if the program was linked with [-g]. *)
+
+val available : bool
+(** [available] is [true] when the runtime supports the profiler. It
+    is [false] on the Unix backend, where the functions below do
+    nothing. *)
+
+type site = {
+  samples : int;    (** Sampled words allocated from this site. *)
+  major : int;      (** Samples allocated directly in the major heap. *)
+  promoted : int;   (** Samples promoted from the minor heap. *)
+  survived : int;   (** Samples that survived a major collection. *)
+  live : int;       (** Samples that are still reachable, as far as
+                        the last collection could tell. *)
+  callstack : Printexc.raw_backtrace;
+                    (** Call stack of the allocation, innermost first. *)
+}
+
+val start : ?rate:float -> unit -> unit
+(** [start ?rate ()] starts sampling, on average, [rate] allocated words
+    per word. [rate] defaults to [1e-4], which costs little even in
+    allocation-heavy code. Restarting with a different rate should be
+    preceded by {!reset}, or the estimates will be off.
+    @raise Invalid_argument if [rate] is not in (0, 1]. *)
+
+val stop : unit -> unit
+(** [stop ()] stops sampling. The sampled blocks are still followed. *)
+
+val reset : unit -> unit
+(** [reset ()] clears the sites and stops following sampled blocks. *)
+
+val rate : unit -> float
+(** [rate ()] is the sampling rate given to the last {!start}. *)
+
+val sites : unit -> site list
+(** [sites ()] is a snapshot of the sites, with the most sampled one
+    first. *)
+
+val words : site -> float
+(** [words s] estimates the number of words allocated from [s]. *)
+
+val dump : ?max_sites:int -> unit -> unit
+(** [dump ?max_sites ()] prints the [max_sites] (default 10) most
+    sampled sites and their call stacks on the console. *)
+
+val to_cstruct : Cstruct.t -> int
+(** [to_cstruct buf] writes a compact binary profile at the start of
+    [buf] and returns its size, which is [0] when the profiler is not
+    {!available}. The profile holds the counters of every site and the
+    return addresses of its call stack, in host byte order, and can be
+    analysed offline against the unikernel image.
+    @raise Failure if [buf] is too small. *)
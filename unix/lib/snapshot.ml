@@ -0,0 +1,68 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+(* Same image format as on Xen: [magic] followed by the marshaled list
+   of the values given by [memo], with their names. *)
+let magic = "MIRSNAP1"
+
+let saved : (string * Obj.t) list ref = ref []
+
+let read_file name =
+  let ic = open_in_bin name in
+  try
+    let s = String.create (in_channel_length ic) in
+    really_input ic s 0 (String.length s);
+    close_in ic;
+    s
+  with e -> close_in_noerr ic; raise e
+
+let restored_values = lazy (
+  match try Some (Sys.getenv "MIRAGE_SNAPSHOT") with Not_found -> None with
+  | None -> None
+  | Some file ->
+    try
+      let s = read_file file in
+      let hd = String.length magic in
+      if String.length s <= hd || String.sub s 0 hd <> magic
+      then failwith "not a snapshot image";
+      let values : (string * Obj.t) list = Marshal.from_string s hd in
+      let t = Hashtbl.create 16 in
+      List.iter (fun (name, v) -> Hashtbl.replace t name v) values;
+      Some t
+    with Failure msg | Sys_error msg ->
+      Printf.printf "Snapshot: ignoring %s: %s\n%!" file msg;
+      None
+)
+
+let restored () = Lazy.force restored_values <> None
+
+let memo name init =
+  let v =
+    match Lazy.force restored_values with
+    | Some t when Hashtbl.mem t name -> Obj.obj (Hashtbl.find t name)
+    | Some _ | None -> init () in
+  saved := (name, Obj.repr v) :: List.remove_assoc name !saved;
+  v
+
+let image () = magic ^ Marshal.to_string !saved [ Marshal.Closures ]
+
+let size () = String.length (image ())
+
+let to_cstruct buf =
+  let s = image () in
+  if Cstruct.len buf < String.length s then failwith "Snapshot.to_cstruct";
+  Cstruct.blit_from_string s 0 buf 0 (String.length s);
+  String.length s
@@ -0,0 +1,125 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+let magic = "MIRARCH1"
+let header_size = 16
+let entry_size = 16
+
+type t = {
+  buf : Cstruct.t;
+  count : int;
+  slots : int;
+}
+
+(* Read as two halves, since a 32-bit value does not fit in an int on a
+   32-bit platform. *)
+let get buf off =
+  let lo = Cstruct.LE.get_uint16 buf off
+  and hi = Cstruct.LE.get_uint16 buf (off + 2) in
+  if hi > max_int lsr 16 then invalid_arg "Archive: offset out of range";
+  (hi lsl 16) lor lo
+let set buf off v = Cstruct.LE.set_uint32 buf off (Int32.of_int v)
+
+(* FNV-1a, kept to 30 bits so that it is the same on every platform. *)
+let hash name =
+  let h = ref 0x011c9dc5 in
+  for i = 0 to String.length name - 1 do
+    h := ((!h lxor Char.code name.[i]) * 16777619) land 0x3fffffff
+  done;
+  !h
+
+let of_cstruct buf =
+  let m = String.length magic in
+  if Cstruct.len buf < header_size
+  || Cstruct.to_string (Cstruct.sub buf 0 m) <> magic
+  then invalid_arg "Archive.of_cstruct";
+  let count = get buf 8 and slots = get buf 12 in
+  if slots = 0 || slots land (slots - 1) <> 0 || count >= slots
+  || header_size + 4 * slots + entry_size * count > Cstruct.len buf
+  then invalid_arg "Archive.of_cstruct";
+  { buf; count; slots }
+
+let length a = a.count
+
+let entry a i = header_size + 4 * a.slots + entry_size * i
+
+let name a i =
+  let e = entry a i in
+  Cstruct.sub a.buf (get a.buf e) (get a.buf (e + 4))
+
+let contents a i =
+  let e = entry a i in
+  Cstruct.sub a.buf (get a.buf (e + 8)) (get a.buf (e + 12))
+
+let name_is a i s =
+  let n = name a i in
+  Cstruct.len n = String.length s &&
+  let rec loop j =
+    j = String.length s || (Cstruct.get_char n j = s.[j] && loop (j + 1)) in
+  loop 0
+
+let find a s =
+  let mask = a.slots - 1 in
+  let rec probe slot tries =
+    if tries = a.slots then None else
+    match get a.buf (header_size + 4 * slot) with
+    | 0 -> None
+    | i when name_is a (i - 1) s -> Some (contents a (i - 1))
+    | _ -> probe ((slot + 1) land mask) (tries + 1) in
+  probe (hash s land mask) 0
+
+let iter f a =
+  for i = 0 to a.count - 1 do
+    f (Cstruct.to_string (name a i)) (contents a i)
+  done
+
+let align8 n = (n + 7) land (lnot 7)
+
+let build files =
+  let count = List.length files in
+  let slots = ref 1 in
+  while !slots <= 2 * count do slots := 2 * !slots done;
+  let slots = !slots in
+  let names = header_size + 4 * slots + entry_size * count in
+  let data =
+    align8 (List.fold_left (fun n (s, _) -> n + String.length s) names files) in
+  let size =
+    List.fold_left (fun n (_, c) -> align8 n + Cstruct.len c) data files in
+  let buf = Cstruct.create size in
+  for i = 0 to size - 1 do Cstruct.set_uint8 buf i 0 done;
+  Cstruct.blit_from_string magic 0 buf 0 (String.length magic);
+  set buf 8 count;
+  set buf 12 slots;
+  let a = { buf; count; slots } in
+  let mask = slots - 1 in
+  ignore (List.fold_left (fun (i, n, d) (s, c) ->
+    let e = entry a i in
+    let d = align8 d in
+    set buf e n;
+    set buf (e + 4) (String.length s);
+    set buf (e + 8) d;
+    set buf (e + 12) (Cstruct.len c);
+    Cstruct.blit_from_string s 0 buf n (String.length s);
+    Cstruct.blit c 0 buf d (Cstruct.len c);
+    let rec insert slot =
+      match get buf (header_size + 4 * slot) with
+      | 0 -> set buf (header_size + 4 * slot) (i + 1)
+      | j when name_is a (j - 1) s -> invalid_arg "Archive.build"
+      | _ -> insert ((slot + 1) land mask) in
+    insert (hash s land mask);
+    i + 1, n + String.length s, d + Cstruct.len c
+  ) (0, names, data) files);
+  buf
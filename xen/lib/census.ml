@@ -0,0 +1,101 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+open Lwt
+
+let available = true
+
+(* Same order as the Census_* constants of census.h. *)
+type status =
+  | Idle
+  | Requested
+  | Running
+  | Done
+
+(* Same layout as the block built by caml_census_result. *)
+type census = {
+  live_blocks : int;
+  live_words : int;
+  free_words : int;
+  garbage_words : int;
+  tag_blocks : int array;
+  tag_words : int array;
+  class_blocks : int array;
+  class_words : int array;
+  dump_bytes : int;
+  truncated : bool;
+}
+
+external request : unit -> unit = "caml_census_request"
+external request_dump : Cstruct.buffer -> int -> int -> unit
+  = "caml_census_request_dump"
+external cancel : unit -> unit = "caml_census_cancel"
+external status : unit -> status = "caml_census_status"
+external raw_result : unit -> census = "caml_census_result"
+
+let start ?dump () =
+  match dump with
+  | None -> request ()
+  | Some b -> request_dump b.Cstruct.buffer b.Cstruct.off b.Cstruct.len
+
+let result () =
+  match status () with
+  | Done -> Some (raw_result ())
+  | Idle | Requested | Running -> None
+
+let run ?dump () =
+  start ?dump ();
+  let rec loop () =
+    match result () with
+    | Some c -> return c
+    | None ->
+      ignore (Gc.major_slice 0);
+      Time.sleep 0. >>= loop in
+  loop ()
+
+let tag_name = function
+  | 246 -> "lazy"
+  | 247 -> "closure"
+  | 248 -> "object"
+  | 249 -> "infix"
+  | 250 -> "forward"
+  | 251 -> "abstract"
+  | 252 -> "string"
+  | 253 -> "double"
+  | 254 -> "double array"
+  | 255 -> "custom"
+  | t -> Printf.sprintf "tag %d" t
+
+let print ?(max_tags=10) c =
+  Printf.printf "Heap census: %d live blocks, %d live words, %d free, %d garbage\n"
+    c.live_blocks c.live_words c.free_words c.garbage_words;
+  let tags = Array.to_list (Array.mapi (fun t w -> t, w) c.tag_words) in
+  let tags = List.sort (fun (_, a) (_, b) -> compare b a) tags in
+  List.iteri (fun i (t, w) ->
+    if i < max_tags && w > 0 then
+      Printf.printf "  %-12s %10d blocks %12d words\n"
+        (tag_name t) c.tag_blocks.(t) w
+  ) tags;
+  Array.iteri (fun i n ->
+    if n > 0 then
+      Printf.printf "  %d-%d words: %d blocks, %d words\n"
+        (if i = 0 then 0 else 1 lsl i) ((1 lsl (i + 1)) - 1)
+        n c.class_words.(i)
+  ) c.class_blocks;
+  if c.dump_bytes > 0 then
+    Printf.printf "  heap dump: %d bytes%s\n" c.dump_bytes
+      (if c.truncated then " (truncated)" else "");
+  flush stdout
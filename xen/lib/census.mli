@@ -0,0 +1,78 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+(** Census of the major heap.
+
+    A census counts the live blocks of the major heap by tag and by
+    size class. It is taken by the collector itself during the sweep
+    phase of the next major cycle, so the heap is walked a slice at a
+    time and the program keeps running meanwhile. A block counts as
+    live if the marking phase that precedes the sweep found it
+    reachable.
+
+    A census can also write a heap dump: the address, size, tag and
+    outgoing pointers of every live block, the global, stack and C
+    roots, and the call stack of the blocks followed by {!Memprof}. It
+    is enough to compute retained sizes offline. *)
+
+val available : bool
+(** [available] is [true] when the runtime supports the census. It is
+    [false] on the Unix backend, where no census is ever taken. *)
+
+type status =
+  | Idle       (** No census was requested. *)
+  | Requested  (** Waiting for the next sweep phase. *)
+  | Running    (** The sweep phase is counting blocks. *)
+  | Done       (** The result is available. *)
+
+type census = {
+  live_blocks : int;
+  live_words : int;           (** Including headers. *)
+  free_words : int;           (** In the free list. *)
+  garbage_words : int;        (** Reclaimed by this sweep. *)
+  tag_blocks : int array;     (** Live blocks by tag. *)
+  tag_words : int array;      (** Live words by tag. *)
+  class_blocks : int array;   (** Live blocks by size class. Class [i]
+                                  holds blocks of [2^i] to [2^(i+1)-1]
+                                  words, class 0 also the empty ones. *)
+  class_words : int array;    (** Live words by size class. *)
+  dump_bytes : int;           (** Size of the heap dump, [0] if none. *)
+  truncated : bool;           (** The heap dump did not fit. *)
+}
+
+val start : ?dump:Cstruct.t -> unit -> unit
+(** [start ?dump ()] requests a census, replacing any earlier one. If
+    [dump] is given, a heap dump is written at its start. The format is
+    documented in [census.c]; blocks are omitted once [dump] is full.
+    [dump] must not be used until the census is {!Done}.
+    @raise Invalid_argument if [dump] is shorter than 8 bytes. *)
+
+val cancel : unit -> unit
+(** [cancel ()] abandons the current census. *)
+
+val status : unit -> status
+
+val result : unit -> census option
+(** [result ()] is the last census, once it is {!Done}. *)
+
+val run : ?dump:Cstruct.t -> unit -> census Lwt.t
+(** [run ?dump ()] starts a census and drives the major collector one
+    slice at a time, yielding to other threads in between, until the
+    census is complete. *)
+
+val print : ?max_tags:int -> census -> unit
+(** [print ?max_tags c] prints [c] on the console, with the [max_tags]
+    (default 10) tags that hold most words. *)
@@ -0,0 +1,44 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+external output_value_to_bigarray :
+  Cstruct.buffer -> int -> int -> 'a -> Marshal.extern_flags list -> int =
+  "caml_output_value_to_bigarray"
+external output_value_size : 'a -> Marshal.extern_flags list -> int =
+  "caml_output_value_size"
+external input_value_from_bigarray : Cstruct.buffer -> int -> int -> 'a =
+  "caml_input_value_from_bigarray"
+
+let header_size = Marshal.header_size
+
+let flags sharing closures =
+  (if sharing then [] else [ Marshal.No_sharing ])
+  @ (if closures then [ Marshal.Closures ] else [])
+
+let size ?(sharing=true) ?(closures=false) v =
+  output_value_size v (flags sharing closures)
+
+let to_cstruct ?(sharing=true) ?(closures=false) buf v =
+  output_value_to_bigarray buf.Cstruct.buffer buf.Cstruct.off buf.Cstruct.len
+    v (flags sharing closures)
+
+let of_cstruct buf =
+  input_value_from_bigarray buf.Cstruct.buffer buf.Cstruct.off buf.Cstruct.len
+
+let total_size buf =
+  if Cstruct.len buf < header_size
+  then invalid_arg "Cmarshal.total_size";
+  header_size + (Int32.to_int (Cstruct.BE.get_uint32 buf 4) land 0xffffffff)
@@ -0,0 +1,50 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+(** Marshaling directly to and from Cstruct buffers, such as shared ring
+    slots or I/O pages, without an intermediate string. The format is
+    the one used by the standard [Marshal] module. *)
+
+val header_size : int
+(** [header_size] is the size of the header that prefixes every
+    marshaled value, in bytes. *)
+
+val size : ?sharing:bool -> ?closures:bool -> 'a -> int
+(** [size ?sharing ?closures v] is the number of bytes
+    [to_cstruct ?sharing ?closures] will write for [v]. [v] is marshaled
+    to compute it, so only use this when the buffer cannot simply be made
+    large enough up front. *)
+
+val to_cstruct : ?sharing:bool -> ?closures:bool -> Cstruct.t -> 'a -> int
+(** [to_cstruct ?sharing ?closures buf v] marshals [v] at the start of
+    [buf] and returns the number of bytes written. If [sharing] is
+    [false] (it defaults to [true]), shared sub-values are written out
+    once per reference and no per-object bookkeeping is done, which is
+    faster for acyclic data but loops forever on cyclic data. If
+    [closures] is [true] (it defaults to [false]), functional values are
+    marshaled as code pointers, which only the same program can read
+    back, as with [Marshal.Closures].
+    @raise Failure if [buf] is too small. *)
+
+val of_cstruct : Cstruct.t -> 'a
+(** [of_cstruct buf] unmarshals the value at the start of [buf]. As with
+    [Marshal.from_string], this is not type-safe.
+    @raise Failure if [buf] does not hold a complete marshaled value. *)
+
+val total_size : Cstruct.t -> int
+(** [total_size buf] is the size in bytes of the marshaled value that
+    starts [buf], header included. Only the first [header_size] bytes
+    need to be present. *)
@@ -0,0 +1,65 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+type stats = {
+  compactions : int;
+  skipped : int;
+  last_pause : float;
+  max_pause : float;
+  pauses : int array;
+  released_chunks : int;
+  released_bytes : int;
+}
+
+(* Same layout as the block built by caml_gc_compaction_stats; the
+   pauses are in microseconds. *)
+type raw_stats = {
+  r_compactions : int;
+  r_skipped : int;
+  r_last_pause : int;
+  r_max_pause : int;
+  r_pauses : int array;
+  r_released_chunks : int;
+  r_released_bytes : int;
+}
+
+external raw_stats : unit -> raw_stats = "caml_gc_compaction_stats"
+external get_budget : unit -> int = "caml_gc_get_compaction_budget"
+external set_budget : int -> unit = "caml_gc_set_compaction_budget"
+external set_release_chunks : bool -> unit = "caml_gc_set_release_chunks"
+external release_free_chunks : unit -> int = "caml_gc_release_free_chunks"
+
+let seconds us = float_of_int us *. 1e-6
+
+let stats () =
+  let r = raw_stats () in
+  { compactions = r.r_compactions;
+    skipped = r.r_skipped;
+    last_pause = seconds r.r_last_pause;
+    max_pause = seconds r.r_max_pause;
+    pauses = r.r_pauses;
+    released_chunks = r.r_released_chunks;
+    released_bytes = r.r_released_bytes }
+
+let pause_budget () = seconds (get_budget ())
+
+let set_pause_budget s =
+  if s < 0. then invalid_arg "Compaction.set_pause_budget";
+  set_budget (int_of_float (s *. 1e6))
+
+let bucket_bounds i =
+  if i < 0 || i >= 32 then invalid_arg "Compaction.bucket_bounds";
+  (if i = 0 then 0. else ldexp 1e-6 i), ldexp 1e-6 (i + 1)
@@ -0,0 +1,67 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+(** Control over major heap compaction.
+
+    A compaction stops the world until it is finished, which can take
+    hundreds of milliseconds on a large heap. These functions bound
+    those pauses and measure them. Heap chunks that hold no live data
+    are given back at the end of every major cycle. Doing that is cheap
+    and is often enough to keep the heap overhead below
+    [Gc.max_overhead] without compacting at all. *)
+
+type stats = {
+  compactions : int;      (** Compactions performed so far. *)
+  skipped : int;          (** Automatic compactions skipped because they
+                              were predicted to exceed the pause budget. *)
+  last_pause : float;     (** Duration of the last compaction, in seconds. *)
+  max_pause : float;      (** Longest compaction so far, in seconds. *)
+  pauses : int array;     (** Histogram of compaction pauses: see
+                              {!bucket_bounds}. *)
+  released_chunks : int;  (** Empty heap chunks given back so far. *)
+  released_bytes : int;   (** Total size of those chunks. *)
+}
+
+val stats : unit -> stats
+(** [stats ()] is a snapshot of the compaction statistics. *)
+
+val bucket_bounds : int -> float * float
+(** [bucket_bounds i] is the range [(lo, hi)] of pause durations, in
+    seconds, counted by [(stats ()).pauses.(i)]. The buckets double in
+    size, starting from one microsecond. *)
+
+val pause_budget : unit -> float
+(** [pause_budget ()] is the current pause budget in seconds. [0.]
+    means that there is no budget. *)
+
+val set_pause_budget : float -> unit
+(** [set_pause_budget s] skips the automatic compactions that are
+    predicted to take longer than [s] seconds. The prediction is based
+    on the cost per heap word of the previous compactions. After 8
+    skips in a row, the next automatic compaction runs anyway, so that
+    fragmentation stays bounded. Skipped compactions can also be
+    performed at a convenient time with [Gc.compact]. [0.] (the default)
+    removes the budget. *)
+
+val set_release_chunks : bool -> unit
+(** [set_release_chunks b] turns on (the default) or off the release
+    of empty heap chunks at the end of each major cycle. *)
+
+val release_free_chunks : unit -> int
+(** [release_free_chunks ()] finishes the current major cycle, gives
+    back the heap chunks that hold no live data, and returns the number
+    of bytes released. It keeps the free space that [Gc.space_overhead]
+    requires. *)
@@ -0,0 +1,46 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+(* The constructors are in the order of the CAML_GC_TRACE_* phases. *)
+type phase = Minor | Mark | Sweep | Compact
+
+type histogram = {
+  count : int;
+  total : float;
+  max : float;
+  buckets : int array;
+}
+
+(* Same layout as the blocks built by caml_gc_trace_events. *)
+type event = {
+  phase : phase;
+  start : float;
+  duration : float;
+  work : int;
+}
+
+external set_enabled : bool -> unit = "caml_gc_trace_set_enabled"
+external reset : unit -> unit = "caml_gc_trace_reset"
+external histogram : phase -> histogram = "caml_gc_trace_histogram"
+external recent : unit -> event array = "caml_gc_trace_events"
+external dump : unit -> unit = "caml_gc_trace_console"
+
+let enable () = set_enabled true
+let disable () = set_enabled false
+
+let bucket_bounds i =
+  if i < 0 || i >= 48 then invalid_arg "Gc_trace.bucket_bounds";
+  (if i = 0 then 0. else ldexp 1e-9 i), ldexp 1e-9 (i + 1)
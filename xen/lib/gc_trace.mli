@@ -0,0 +1,72 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+(** Tracing of garbage collector pauses.
+
+    When tracing is enabled, the runtime times every minor collection,
+    major GC slice and compaction with the monotonic clock. Each pause
+    is counted in a histogram for its phase and appended to a ring of
+    the last 256 pauses. Tracing costs two clock reads per pause and is
+    cheap enough to leave on in production. It is off by default. *)
+
+type phase =
+  | Minor     (** Minor collection. *)
+  | Mark      (** Major GC marking slice. *)
+  | Sweep     (** Major GC sweeping slice. *)
+  | Compact   (** Heap compaction. *)
+
+type histogram = {
+  count : int;          (** Number of pauses. *)
+  total : float;        (** Total time spent in these pauses, in seconds. *)
+  max : float;          (** Longest pause, in seconds. *)
+  buckets : int array;  (** Pause counts: see {!bucket_bounds}. *)
+}
+
+type event = {
+  phase : phase;
+  start : float;        (** Monotonic time at which the pause started,
+                            in seconds. *)
+  duration : float;     (** Length of the pause, in seconds. *)
+  work : int;           (** Words processed: the size of the minor heap,
+                            the work requested from a major slice, or
+                            the size of the major heap. *)
+}
+
+val enable : unit -> unit
+(** [enable ()] starts tracing. *)
+
+val disable : unit -> unit
+(** [disable ()] stops tracing. The data collected so far is kept. *)
+
+val reset : unit -> unit
+(** [reset ()] clears the histograms and the recent events. *)
+
+val histogram : phase -> histogram
+(** [histogram p] is a snapshot of the pause histogram of phase [p]. *)
+
+val bucket_bounds : int -> float * float
+(** [bucket_bounds i] is the range [(lo, hi)] of pause durations, in
+    seconds, counted by [(histogram p).buckets.(i)]. The buckets double
+    in size, starting from one nanosecond. *)
+
+val recent : unit -> event array
+(** [recent ()] is the last recorded pauses, oldest first. Minor
+    collections start major slices, so a [Mark] or [Sweep] event often
+    follows a [Minor] one as part of the same pause. *)
+
+val dump : unit -> unit
+(** [dump ()] prints the histograms and the last few pauses on the
+    console. *)
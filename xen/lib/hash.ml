@@ -0,0 +1,77 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+external sha_accelerated : unit -> bool = "caml_hash_sha_accelerated"
+external crc32c_accelerated : unit -> bool = "caml_hash_crc32c_accelerated"
+
+module type S = sig
+  type t
+  val digest_size : int
+  val init : unit -> t
+  val update : t -> Cstruct.t -> unit
+  val finalize : t -> string
+  val digest : Cstruct.t -> string
+  val digestv : Cstruct.t list -> string
+  val accelerated : bool
+end
+
+(* The contexts are opaque strings owned by the C stubs *)
+module Make(H : sig
+  val digest_size : int
+  val init : unit -> string
+  val update : string -> Cstruct.buffer -> int -> int -> unit
+  val final : string -> string
+end) = struct
+  type t = string
+  let digest_size = H.digest_size
+  let init = H.init
+  let update t buf = H.update t buf.Cstruct.buffer buf.Cstruct.off buf.Cstruct.len
+  let finalize = H.final
+  let digestv bufs =
+    let t = init () in
+    List.iter (update t) bufs;
+    finalize t
+  let digest buf = digestv [buf]
+  let accelerated = sha_accelerated ()
+end
+
+module Sha1 = Make(struct
+  let digest_size = 20
+  external init : unit -> string = "caml_hash_sha1_init"
+  external update : string -> Cstruct.buffer -> int -> int -> unit =
+    "caml_hash_sha1_update" "noalloc"
+  external final : string -> string = "caml_hash_sha1_final"
+end)
+
+module Sha256 = Make(struct
+  let digest_size = 32
+  external init : unit -> string = "caml_hash_sha256_init"
+  external update : string -> Cstruct.buffer -> int -> int -> unit =
+    "caml_hash_sha256_update" "noalloc"
+  external final : string -> string = "caml_hash_sha256_final"
+end)
+
+module Crc32c = struct
+  external crc32c : int32 -> Cstruct.buffer -> int -> int -> int32 = "caml_hash_crc32c"
+
+  let digest ?(crc=0l) buf =
+    crc32c crc buf.Cstruct.buffer buf.Cstruct.off buf.Cstruct.len
+
+  let digestv ?(crc=0l) bufs =
+    List.fold_left (fun crc buf -> digest ~crc buf) crc bufs
+
+  let accelerated = crc32c_accelerated ()
+end
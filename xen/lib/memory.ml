@@ -0,0 +1,61 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+type io_page_stats = {
+  io_page_bytes : int;
+  io_page_budget : int;
+  domain_bytes : int;
+  forced_collections : int;
+  failed_allocations : int;
+}
+
+external io_page_stats : unit -> io_page_stats = "caml_io_page_stats"
+external set_io_page_budget : int -> unit = "caml_io_page_set_budget"
+
+type report = {
+  total : int;
+  kernel : int;
+  stack : int;
+  major_heap : int;
+  major_free : int;
+  minor_heap : int;
+  io_pages : int;
+  granted_bytes : int;
+  mapped_bytes : int;
+  bigarrays : int;
+  other : int;
+}
+
+external report : unit -> report = "caml_memory_report"
+
+let print_report () =
+  let r = report () in
+  let kib n = n / 1024 in
+  let line name n =
+    Printf.printf "  %-12s %8d KiB %3d%%\n" name (kib n)
+      (if r.total = 0 then 0 else n * 100 / r.total) in
+  Printf.printf "Memory: %d KiB\n" (kib r.total);
+  line "kernel" r.kernel;
+  line "stack" r.stack;
+  line "major heap" r.major_heap;
+  Printf.printf "    free %d KiB\n" (kib r.major_free);
+  line "minor heap" r.minor_heap;
+  line "I/O pages" r.io_pages;
+  Printf.printf "    granted %d KiB, mapped %d KiB\n"
+    (kib r.granted_bytes) (kib r.mapped_bytes);
+  line "bigarrays" r.bigarrays;
+  line "other" r.other;
+  flush stdout
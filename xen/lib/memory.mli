@@ -0,0 +1,67 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+(** Memory usage of the domain. *)
+
+(** I/O pages live outside the OCaml heap and are only freed when the
+    GC finalises their last reference. Their total size is counted
+    against a budget, which defaults to half of the domain memory. The
+    more of it they use, the harder the major GC works. An allocation
+    that would go over the budget first runs a full major cycle to
+    reclaim the unreachable pages. An allocation that fails is retried
+    once after a full major cycle. *)
+type io_page_stats = {
+  io_page_bytes : int;       (** Bytes of I/O pages currently live. *)
+  io_page_budget : int;      (** The budget, in bytes. *)
+  domain_bytes : int;        (** Memory given to the domain, in bytes. *)
+  forced_collections : int;  (** Major cycles run by the page allocator. *)
+  failed_allocations : int;  (** Page allocations that failed even after
+                                 a collection. *)
+}
+
+val io_page_stats : unit -> io_page_stats
+(** [io_page_stats ()] is a snapshot of the I/O page accounting. *)
+
+val set_io_page_budget : int -> unit
+(** [set_io_page_budget bytes] sets the I/O page budget.
+    @raise Invalid_argument if [bytes] is not positive. *)
+
+(** Where the memory of the domain goes, in bytes. The figures come from
+    counters kept up to date by the runtime, so taking a report is
+    cheap. The categories do not overlap, and add up to [total]. *)
+type report = {
+  total : int;          (** Memory given to the domain. *)
+  kernel : int;         (** Laid out by the domain builder at boot: the
+                            kernel image, boot modules and page tables. *)
+  stack : int;          (** The boot stack, which runs the program. *)
+  major_heap : int;     (** The OCaml major heap, ... *)
+  major_free : int;     (** ... of which this is in its free list. *)
+  minor_heap : int;     (** The OCaml minor heap. *)
+  io_pages : int;       (** Live I/O pages, ... *)
+  granted_bytes : int;  (** ... of which these are granted to other
+                            domains, ... *)
+  mapped_bytes : int;   (** ... and these map pages of other domains. *)
+  bigarrays : int;      (** Other bigarrays allocated by OCaml. *)
+  other : int;          (** Everything else: free memory, other uses of
+                            [malloc] (custom blocks, runtime tables) and
+                            the page tables that mini-os builds. *)
+}
+
+val report : unit -> report
+(** [report ()] is a breakdown of the memory of the domain. *)
+
+val print_report : unit -> unit
+(** [print_report ()] prints {!report} on the console. *)
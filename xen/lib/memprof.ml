@@ -0,0 +1,78 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+let available = true
+
+(* Same layout as the blocks built by caml_memprof_sites. *)
+type site = {
+  samples : int;
+  major : int;
+  promoted : int;
+  survived : int;
+  live : int;
+  callstack : Printexc.raw_backtrace;
+}
+
+type status = {
+  running : bool;
+  r_rate : float;
+  tracked : int;
+  untracked : int;
+}
+
+external start : float -> unit = "caml_memprof_start"
+external stop : unit -> unit = "caml_memprof_stop"
+external reset : unit -> unit = "caml_memprof_reset"
+external status : unit -> status = "caml_memprof_status"
+external raw_sites : unit -> site array = "caml_memprof_sites"
+external write : Cstruct.buffer -> int -> int -> int = "caml_memprof_write"
+
+let start ?(rate=1e-4) () = start rate
+
+let rate () = (status ()).r_rate
+
+let sites () =
+  let s = raw_sites () in
+  Array.sort (fun a b -> compare b.samples a.samples) s;
+  Array.to_list s
+
+let words s =
+  let r = rate () in
+  if r > 0. then float_of_int s.samples /. r else 0.
+
+let percent n s = if s.samples = 0 then 0 else n * 100 / s.samples
+
+let dump ?(max_sites=10) () =
+  let all = sites () in
+  Printf.printf "Allocation profile: %d sites, rate %g\n"
+    (List.length all) (rate ());
+  List.iteri (fun i s ->
+    if i < max_sites then begin
+      Printf.printf
+        "%.0f words: %d%% major, %d%% promoted, %d%% survived, %d live\n"
+        (words s) (percent s.major s) (percent s.promoted s)
+        (percent s.survived s) s.live;
+      match Printexc.raw_backtrace_to_string s.callstack with
+      | "" -> print_string "  (unknown call stack)\n"
+      | bt -> print_string bt
+    end
+  ) all;
+  flush stdout
+
+let to_cstruct buf =
+  let n = write buf.Cstruct.buffer buf.Cstruct.off buf.Cstruct.len in
+  if n < 0 then failwith "Memprof.to_cstruct: buffer too small";
+  n
@@ -0,0 +1,34 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+type stats = {
+  adaptive : bool;
+  min_words : int;
+  max_words : int;
+  size_words : int;
+  grows : int;
+  shrinks : int;
+  survival : float;
+}
+
+(* Same layout as the block built by caml_gc_minor_heap_stats. *)
+external stats : unit -> stats = "caml_gc_minor_heap_stats"
+external set_adaptive : bool -> unit = "caml_gc_set_minor_heap_adaptive"
+external set_bounds : int -> int -> unit = "caml_gc_set_minor_heap_bounds"
+
+let set_bounds ~min_words ~max_words =
+  if min_words < 0 || max_words < 0 then invalid_arg "Minor_heap.set_bounds";
+  set_bounds min_words max_words
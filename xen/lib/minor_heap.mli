@@ -0,0 +1,55 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+(** Adaptive sizing of the minor heap.
+
+    The runtime measures the fraction of the minor heap that survives
+    to the major heap and how often the minor heap fills up. It doubles
+    the minor heap when too much survives or when the collections are
+    too frequent, and halves it when almost nothing survives. Less data
+    is promoted, so the major GC has less work to do, and programs that
+    only allocate short-lived values keep a small minor heap that stays
+    in the cache. The size always stays between two bounds.
+
+    The sizing is on by default. An explicit size is never overridden:
+    giving the size in [OCAMLRUNPARAM] ([s=]) or changing it with
+    [Gc.set] turns the sizing off. *)
+
+type stats = {
+  adaptive : bool;     (** Whether the minor heap is resized. *)
+  min_words : int;     (** Lower bound, in words. *)
+  max_words : int;     (** Upper bound, in words. *)
+  size_words : int;    (** Current size of the minor heap, in words. *)
+  grows : int;         (** Number of times the minor heap was grown. *)
+  shrinks : int;       (** Number of times the minor heap was shrunk. *)
+  survival : float;    (** Fraction of the minor words promoted to the
+                           major heap during the last measurement. *)
+}
+
+val stats : unit -> stats
+(** [stats ()] is a snapshot of the minor heap sizing state. *)
+
+val set_adaptive : bool -> unit
+(** [set_adaptive b] turns on (the default) or off the resizing of the
+    minor heap. When it is off, the size only changes with [Gc.set]. *)
+
+val set_bounds : min_words:int -> max_words:int -> unit
+(** [set_bounds ~min_words ~max_words] sets the range within which the
+    minor heap is resized. The defaults are [256k] and [1M] words. The
+    bounds are clamped to the limits accepted by [Gc.set], and
+    [max_words] is raised to [min_words] if it is smaller. The current
+    size is not changed immediately, even if it is outside the new
+    bounds. *)
@@ -0,0 +1,72 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+(* An image is [magic] followed by the marshaled list of the values
+   given by [memo], with their names. *)
+let magic = "MIRSNAP1"
+
+let saved : (string * Obj.t) list ref = ref []
+
+let is_image m =
+  Cstruct.len m > String.length magic
+  && Cstruct.to_string (Cstruct.sub m 0 (String.length magic)) = magic
+
+(* The boot module is either the image itself, or an archive that holds
+   it as "snapshot". *)
+let boot_image () =
+  let image =
+    match Start_info.boot_module () with
+    | Some m when is_image m -> Some m
+    | Some m ->
+      (try Archive.find (Archive.of_cstruct m) "snapshot"
+       with Invalid_argument _ -> None)
+    | None -> None in
+  match image with
+  | Some m when is_image m -> Some (Cstruct.shift m (String.length magic))
+  | Some _ | None -> None
+
+let restored_values = lazy (
+  match boot_image () with
+  | None -> None
+  | Some buf ->
+    try
+      let values : (string * Obj.t) list = Cmarshal.of_cstruct buf in
+      let t = Hashtbl.create 16 in
+      List.iter (fun (name, v) -> Hashtbl.replace t name v) values;
+      Some t
+    with Failure msg ->
+      Printf.printf "Snapshot: ignoring the boot image: %s\n%!" msg;
+      None
+)
+
+let restored () = Lazy.force restored_values <> None
+
+let memo name init =
+  let v =
+    match Lazy.force restored_values with
+    | Some t when Hashtbl.mem t name -> Obj.obj (Hashtbl.find t name)
+    | Some _ | None -> init () in
+  saved := (name, Obj.repr v) :: List.remove_assoc name !saved;
+  v
+
+let size () =
+  String.length magic + Cmarshal.size ~closures:true !saved
+
+let to_cstruct buf =
+  let hd = String.length magic in
+  if Cstruct.len buf < hd then failwith "Snapshot.to_cstruct";
+  Cstruct.blit_from_string magic 0 buf 0 hd;
+  hd + Cmarshal.to_cstruct ~closures:true (Cstruct.shift buf hd) !saved
@@ -0,0 +1,55 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+(** Boot from a snapshot of initialised values.
+
+    Values that take long to build at start of day, such as routing
+    tables, parsed configurations or caches, can be computed once,
+    saved into a snapshot image, and read back from the image by later
+    boots instead of being built again.
+
+    Each such value is named and built through {!memo}. After
+    initialisation, {!to_cstruct} writes every value built through
+    {!memo} into an image, in a single marshaled block, so that the
+    sharing between the values is kept. On the Xen backend, the image is
+    read from the boot module, which is passed to the domain builder as
+    its ramdisk; the boot module can also be an {!Archive} that holds
+    the image as ["snapshot"]. On the Unix backend, it is read from the file named by
+    the [MIRAGE_SNAPSHOT] environment variable.
+
+    Functional values are saved as code pointers, so an image can only be
+    used by the program that wrote it. An image written by another
+    program is detected and ignored. Like [Marshal], this is not
+    type-safe: a name must always be used with the same type. Values that
+    refer to resources of the running domain, such as devices, pages or
+    threads, must not be saved. *)
+
+val memo : string -> (unit -> 'a) -> 'a
+(** [memo name init] is the value saved as [name] in the boot image, if
+    there is one, and [init ()] otherwise. Either way the value is saved
+    as [name] by later calls to {!to_cstruct}. *)
+
+val restored : unit -> bool
+(** [restored ()] is [true] if a boot image was found and read. *)
+
+val size : unit -> int
+(** [size ()] is the size in bytes of the image {!to_cstruct} would
+    write now. *)
+
+val to_cstruct : Cstruct.t -> int
+(** [to_cstruct buf] writes an image of the values built so far
+    through {!memo} at the start of [buf], and returns its size.
+    @raise Failure if [buf] is too small. *)
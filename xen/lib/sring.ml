@@ -0,0 +1,95 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+open Lwt
+
+external _push_requests: Cstruct.buffer -> int -> int -> bool =
+  "stub_sring_push_requests" "noalloc"
+external _push_responses: Cstruct.buffer -> int -> int -> bool =
+  "stub_sring_push_responses" "noalloc"
+external _final_check_for_requests: Cstruct.buffer -> int -> int -> bool =
+  "stub_sring_final_check_for_requests" "noalloc"
+external _final_check_for_responses: Cstruct.buffer -> int -> int -> bool =
+  "stub_sring_final_check_for_responses" "noalloc"
+external _req_prod: Cstruct.buffer -> int -> int = "stub_sring_req_prod" "noalloc"
+external _rsp_prod: Cstruct.buffer -> int -> int = "stub_sring_rsp_prod" "noalloc"
+
+(* 4 indices followed by 48 bytes of private/pad space *)
+let header_size = 64
+
+let idx_mask = 0xffffffff
+
+let nr_ents ~slot_size ring =
+  let n = (Cstruct.len ring - header_size) / slot_size in
+  let rec round_down x = if x land (x - 1) = 0 then x else round_down (x land (x - 1)) in
+  if n <= 0 then 0 else round_down n
+
+let slot ~slot_size ~nr_ents ring idx =
+  Cstruct.sub ring (header_size + (idx land (nr_ents - 1)) * slot_size) slot_size
+
+let push_requests ring req_prod_pvt =
+  _push_requests ring.Cstruct.buffer ring.Cstruct.off (req_prod_pvt land idx_mask)
+
+let push_responses ring rsp_prod_pvt =
+  _push_responses ring.Cstruct.buffer ring.Cstruct.off (rsp_prod_pvt land idx_mask)
+
+let final_check_for_requests ring req_cons =
+  _final_check_for_requests ring.Cstruct.buffer ring.Cstruct.off (req_cons land idx_mask)
+
+let final_check_for_responses ring rsp_cons =
+  _final_check_for_responses ring.Cstruct.buffer ring.Cstruct.off (rsp_cons land idx_mask)
+
+(* A single barrier in [get_prod] covers every slot up to [prod] *)
+let consume get_prod ring cons f =
+  let prod = get_prod ring.Cstruct.buffer ring.Cstruct.off in
+  let rec loop cons =
+    if cons = prod then cons
+    else begin
+      f cons;
+      loop ((cons + 1) land idx_mask)
+    end in
+  loop (cons land idx_mask)
+
+let consume_requests ring req_cons f = consume _req_prod ring req_cons f
+let consume_responses ring rsp_cons f = consume _rsp_prod ring rsp_cons f
+
+let rec ack_requests ring req_cons f =
+  let req_cons = consume_requests ring req_cons f in
+  if final_check_for_requests ring req_cons
+  then ack_requests ring req_cons f
+  else req_cons
+
+let rec ack_responses ring rsp_cons f =
+  let rsp_cons = consume_responses ring rsp_cons f in
+  if final_check_for_responses ring rsp_cons
+  then ack_responses ring rsp_cons f
+  else rsp_cons
+
+(* The event index has been re-armed by the final check before we
+   block, so a notification cannot be lost between the two. *)
+let wait ack ring evtchn cons f =
+  let rec loop event cons =
+    let cons' = ack ring cons f in
+    if cons' <> (cons land idx_mask)
+    then return cons'
+    else begin
+      lwt event = Activations.after evtchn event in
+      loop event cons'
+    end in
+  loop Activations.program_start cons
+
+let wait_for_requests ring evtchn req_cons f = wait ack_requests ring evtchn req_cons f
+let wait_for_responses ring evtchn rsp_cons f = wait ack_responses ring evtchn rsp_cons f
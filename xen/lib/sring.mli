@@ -0,0 +1,83 @@
+(*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *)
+
+(** Batched producer/consumer helpers for standard Xen shared rings.
+
+    The shared page has the layout of [xen/io/ring.h]: a header with
+    the [req_prod], [req_event], [rsp_prod] and [rsp_event] indices,
+    followed by a power-of-two number of fixed-size slots. The caller
+    keeps its private indices ([req_prod_pvt], [rsp_cons], ...) and
+    reads or writes the slots itself; these functions only publish and
+    snapshot the shared indices, so that N slots cost a single barrier.
+    Indices are 32-bit and wrap around. *)
+
+val header_size : int
+(** [header_size] is the number of bytes before the first slot. *)
+
+val nr_ents : slot_size:int -> Cstruct.t -> int
+(** [nr_ents ~slot_size ring] is the number of slots of [slot_size]
+    bytes which fit in the shared ring [ring]. *)
+
+val slot : slot_size:int -> nr_ents:int -> Cstruct.t -> int -> Cstruct.t
+(** [slot ~slot_size ~nr_ents ring idx] is the slot of [ring]
+    corresponding to the (free running) index [idx]. *)
+
+val push_requests : Cstruct.t -> int -> bool
+(** [push_requests ring req_prod_pvt] publishes every request slot up
+    to [req_prod_pvt] with a single write barrier. It returns [true] if
+    the backend must be notified, that is if [req_event] lies within
+    the newly pushed requests. *)
+
+val push_responses : Cstruct.t -> int -> bool
+(** [push_responses ring rsp_prod_pvt] is the backend counterpart of
+    {!push_requests}. *)
+
+val final_check_for_requests : Cstruct.t -> int -> bool
+(** [final_check_for_requests ring req_cons] re-arms [req_event] and
+    checks again for requests which raced with it. If it returns
+    [false] the frontend is guaranteed to notify us about the next
+    request, so it is safe to block. *)
+
+val final_check_for_responses : Cstruct.t -> int -> bool
+(** [final_check_for_responses ring rsp_cons] is the frontend
+    counterpart of {!final_check_for_requests}. *)
+
+val consume_requests : Cstruct.t -> int -> (int -> unit) -> int
+(** [consume_requests ring req_cons f] snapshots [req_prod] once, calls
+    [f idx] for every outstanding request index in order, and returns
+    the new [req_cons]. It does not re-arm [req_event]. *)
+
+val consume_responses : Cstruct.t -> int -> (int -> unit) -> int
+(** [consume_responses ring rsp_cons f] is the frontend counterpart of
+    {!consume_requests}. *)
+
+val ack_requests : Cstruct.t -> int -> (int -> unit) -> int
+(** [ack_requests ring req_cons f] consumes requests as
+    {!consume_requests} until {!final_check_for_requests} reports that
+    no more are pending, and returns the new [req_cons]. *)
+
+val ack_responses : Cstruct.t -> int -> (int -> unit) -> int
+(** [ack_responses ring rsp_cons f] is the frontend counterpart of
+    {!ack_requests}. *)
+
+val wait_for_responses : Cstruct.t -> Eventchn.t -> int -> (int -> unit) -> int Lwt.t
+(** [wait_for_responses ring evtchn rsp_cons f] consumes responses as
+    {!ack_responses}, blocking on [evtchn] until at least one response
+    has been handled, and returns the new [rsp_cons]. *)
+
+val wait_for_requests : Cstruct.t -> Eventchn.t -> int -> (int -> unit) -> int Lwt.t
+(** [wait_for_requests ring evtchn req_cons f] is the backend
+    counterpart of {!wait_for_responses}. *)
@@ -20,3 +20,9 @@ type t = {
 external get: unit -> t = "stub_start_info_get"
 external console_start_page: unit -> Io_page.t = "caml_console_start_page"
 external xenstore_start_page: unit -> Io_page.t = "caml_xenstore_start_page"
+external boot_module_buffer: unit -> Cstruct.buffer option = "caml_boot_module"
+
+let boot_module () =
+  match boot_module_buffer () with
+  | None -> None
+  | Some b -> Some (Cstruct.of_bigarray b)
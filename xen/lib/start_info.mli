@@ -31,3 +31,9 @@ val console_start_page: unit -> Io_page.t
 val xenstore_start_page: unit -> Io_page.t
 (** [xenstore_start_page ()] is the xenstore page automatically
     allocated by Xen. *)
+
+val boot_module: unit -> Cstruct.t option
+(** [boot_module ()] is the module that was loaded with the unikernel
+    (its ramdisk), if there is one, in place and without a copy. Its
+    pages are mapped read-only: writing to the returned buffer faults.
+    See {!Archive} to store several files in it. *)
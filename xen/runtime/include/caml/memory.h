@@ -101,6 +101,11 @@ int caml_page_table_initialize(mlsize_t bytesize);
 #define DEBUG_clear(result, wosize)
 #endif
 
+/* [caml_young_limit] is above [caml_young_start] when the allocation
+   profiler waits for a sampled word (see memprof.h); a C allocation
+   that reaches it is sampled there, without a collection. */
+CAMLextern void caml_memprof_sample_c_young (void);
+
 #define Alloc_small(result, wosize, tag) do{    CAMLassert ((wosize) >= 1); \
                                           CAMLassert ((tag_t) (tag) < 256); \
                                  CAMLassert ((wosize) <= Max_young_wosize); \
@@ -115,6 +120,7 @@ int caml_page_table_initialize(mlsize_t bytesize);
   Hd_hp (caml_young_ptr) = Make_header ((wosize), (tag), Caml_black);       \
   (result) = Val_hp (caml_young_ptr);                                       \
   DEBUG_clear ((result), (wosize));                                         \
+  if (caml_young_ptr < caml_young_limit) caml_memprof_sample_c_young ();    \
 }while(0)
 
 /* Deprecated alias for [caml_modify] */
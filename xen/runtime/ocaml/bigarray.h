@@ -60,10 +60,20 @@ enum caml_ba_managed {
   CAML_BA_MANAGED_MASK = 0x600 /* Mask for "managed" bits in flags field */
 };
 
+/* Managed data made of I/O pages (see caml_alloc_pages in the Xen
+   backend).  Their size is added to [caml_ba_io_page_bytes] by the
+   allocator, and taken off it by the finaliser.  The size of the other
+   managed data is kept in [caml_ba_managed_bytes] in the same way: it
+   is added where the data is malloc'ed ([caml_ba_alloc] with no data,
+   deserialisation), never for sub-arrays, which share the data of
+   their parent.  A C allocator that passes its own data along with
+   CAML_BA_MANAGED must add its size itself. */
+#define CAML_BA_IO_PAGE 0x800
+
 struct caml_ba_proxy {
   intnat refcount;              /* Reference count */
   void * data;                  /* Pointer to base of actual data */
-  uintnat size;                 /* Size of data in bytes (if mapped file) */
+  uintnat size;                 /* Size of data in bytes */
 };
 
 struct caml_ba_array {
@@ -101,5 +111,7 @@ CAMLBAextern value
 CAMLBAextern value caml_ba_alloc_dims(int flags, int num_dims, void * data,
                                  ... /*dimensions, with type intnat */);
 CAMLBAextern uintnat caml_ba_byte_size(struct caml_ba_array * b);
+CAMLBAextern uintnat caml_ba_io_page_bytes;
+CAMLBAextern uintnat caml_ba_managed_bytes;
 
 #endif
@@ -125,6 +125,9 @@ caml_ba_multov(uintnat a, uintnat b, int * overflow)
 /* 1 Gb -- after allocating that much, it's probably worth speeding
    up the major GC */
 
+CAMLexport uintnat caml_ba_io_page_bytes = 0;
+CAMLexport uintnat caml_ba_managed_bytes = 0;
+
 /* [caml_ba_alloc] will allocate a new bigarray object in the heap.
    If [data] is NULL, the memory for the contents is also allocated
    (with [malloc]) by [caml_ba_alloc].
@@ -157,6 +160,7 @@ caml_ba_alloc(int flags, int num_dims, void * data, intnat * dim)
     data = malloc(size);
     if (data == NULL && size != 0) caml_raise_out_of_memory();
     flags |= CAML_BA_MANAGED;
+    caml_ba_managed_bytes += size;
   }
   asize = SIZEOF_BA_ARRAY + num_dims * sizeof(intnat);
   res = caml_alloc_custom(&caml_ba_ops, asize, size, CAML_BA_MAX_MEMORY);
@@ -670,9 +674,17 @@ static void caml_ba_finalize(value v)
     break;
   case CAML_BA_MANAGED:
     if (b->proxy == NULL) {
+      if (b->flags & CAML_BA_IO_PAGE)
+        caml_ba_io_page_bytes -= caml_ba_byte_size(b);
+      else
+        caml_ba_managed_bytes -= caml_ba_byte_size(b);
       free(b->data);
     } else {
       if (-- b->proxy->refcount == 0) {
+        if (b->flags & CAML_BA_IO_PAGE)
+          caml_ba_io_page_bytes -= b->proxy->size;
+        else
+          caml_ba_managed_bytes -= b->proxy->size;
         free(b->proxy->data);
         caml_stat_free(b->proxy);
       }
@@ -974,7 +986,8 @@ uintnat caml_ba_deserialize(void * dst)
 
   /* Read back header information */
   b->num_dims = caml_deserialize_uint_4();
-  b->flags = caml_deserialize_uint_4() | CAML_BA_MANAGED;
+  /* The data is malloc'ed below, so it is not made of I/O pages */
+  b->flags = (caml_deserialize_uint_4() & ~CAML_BA_IO_PAGE) | CAML_BA_MANAGED;
   b->proxy = NULL;
   for (i = 0; i < b->num_dims; i++) b->dim[i] = caml_deserialize_uint_4();
   /* Compute total number of elements */
@@ -987,6 +1000,7 @@ uintnat caml_ba_deserialize(void * dst)
   b->data = malloc(elt_size * num_elts);
   if (b->data == NULL)
     caml_deserialize_error("input_value: out of memory for bigarray");
+  caml_ba_managed_bytes += elt_size * num_elts;
   /* Read data */
   switch (b->flags & CAML_BA_KIND_MASK) {
   case CAML_BA_SINT8:
@@ -1031,8 +1045,7 @@ static void caml_ba_update_proxy(struct caml_ba_array * b1,
     proxy = caml_stat_alloc(sizeof(struct caml_ba_proxy));
     proxy->refcount = 2;      /* original array + sub array */
     proxy->data = b1->data;
-    proxy->size =
-      b1->flags & CAML_BA_MAPPED_FILE ? caml_ba_byte_size(b1) : 0;
+    proxy->size = caml_ba_byte_size(b1);
     b1->proxy = proxy;
     b2->proxy = proxy;
   }
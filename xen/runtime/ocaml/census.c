@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Census of the major heap and heap dump, see census.h. */
+
+#include <string.h>
+#include "alloc.h"
+#include "bigarray.h"
+#include "census.h"
+#include "fail.h"
+#include "gc.h"
+#include "major_gc.h"
+#include "memory.h"
+#include "memprof.h"
+#include "minor_gc.h"
+#include "mlvalues.h"
+#include "roots.h"
+
+int caml_census_state = Census_idle;
+static struct caml_census census;
+
+/* Heap dump. The records are written into a bigarray while the
+   census runs, as a sequence of:
+     "HCNS", u8 version (1), u8 word size
+   then records that start with a kind byte:
+     1 root:   uv address
+     2 block:  sv address delta, uv wosize, u8 tag, uv n,
+               n * sv pointer delta
+     3 sample: uv address, uv depth, depth * uv return address
+     0 end:    u8 truncated
+   where uv is an unsigned LEB128 number and sv a zigzag-encoded signed
+   one. Block addresses are given in words relative to the previous
+   block, and the pointers of a block in words relative to the block
+   itself. Only the pointers to major heap blocks are kept; a block is
+   identified by the address of its first field.
+   The mutator runs between sweep slices, so the dump is not an atomic
+   snapshot: a block reflects its contents at the time it was swept. */
+
+static value dump_buf = Val_unit;   /* keeps the bigarray alive */
+static unsigned char *dump_start, *dump_ptr, *dump_end;
+static int dump_truncated;
+static char *dump_prev;
+
+#define Dump_trailer 2   /* room kept for the end record */
+
+static int put_byte (unsigned char b)
+{
+  if (dump_ptr >= dump_end - Dump_trailer) return 0;
+  *dump_ptr++ = b;
+  return 1;
+}
+
+static int put_uv (uintnat x)
+{
+  while (x >= 0x80){
+    if (!put_byte ((x & 0x7F) | 0x80)) return 0;
+    x >>= 7;
+  }
+  return put_byte (x);
+}
+
+static int put_sv (intnat x)
+{
+  return put_uv (((uintnat) x << 1) ^ (uintnat) (x >> (8 * sizeof (intnat) - 1)));
+}
+
+#define Begin_record(rec) \
+  unsigned char *rec = dump_ptr; \
+  if (dump_start == NULL || dump_truncated) return
+
+#define End_record(rec, ok) do{ \
+    if (!(ok)){ dump_ptr = (rec); dump_truncated = 1; } \
+  }while(0)
+
+static void dump_root (value v, value *p)
+{
+  Begin_record (rec);
+  if (Is_block (v) && Is_in_heap (v)){
+    End_record (rec, put_byte (1) && put_uv ((uintnat) v));
+  }
+}
+
+static void dump_block (char *hp, header_t hd)
+{
+  value v = Val_hp (hp);
+  mlsize_t i, n = 0, sz = Wosize_hd (hd);
+  int ok;
+  Begin_record (rec);
+
+  if (Tag_hd (hd) < No_scan_tag){
+    for (i = 0; i < sz; i++){
+      value f = Field (v, i);
+      if (Is_block (f) && Is_in_heap (f)) ++ n;
+    }
+  }
+  ok = put_byte (2) && put_sv (((char *) v - dump_prev) / (intnat) sizeof (value))
+       && put_uv (sz) && put_byte (Tag_hd (hd)) && put_uv (n);
+  for (i = 0; ok && n > 0 && i < sz; i++){
+    value f = Field (v, i);
+    if (Is_block (f) && Is_in_heap (f)){
+      ok = put_sv (((char *) f - (char *) v) / (intnat) sizeof (value));
+    }
+  }
+  End_record (rec, ok);
+  if (ok) dump_prev = (char *) v;
+}
+
+static void dump_sample (value v, frame_descr **frames, int depth)
+{
+  int i, ok;
+  Begin_record (rec);
+
+  ok = put_byte (3) && put_uv ((uintnat) v) && put_uv (depth);
+  for (i = 0; ok && i < depth; i++) ok = put_uv (frames[i]->retaddr);
+  End_record (rec, ok);
+}
+
+static void dump_release (void)
+{
+  if (dump_start != NULL){
+    caml_remove_generational_global_root (&dump_buf);
+    dump_buf = Val_unit;
+    dump_start = NULL;
+  }
+}
+
+/* Called when the sweep phase starts: the heap is fully marked. */
+void caml_census_sweep_start (void)
+{
+  if (caml_census_state != Census_requested) return;
+  memset (&census, 0, sizeof (census));
+  caml_census_state = Census_running;
+  if (dump_start != NULL){
+    dump_ptr = dump_start;
+    dump_truncated = 0;
+    dump_prev = NULL;
+    memcpy (dump_ptr, "HCNS", 4);
+    dump_ptr[4] = 1;
+    dump_ptr[5] = sizeof (value);
+    dump_ptr += 6;
+    caml_do_roots (dump_root);
+  }
+}
+
+void caml_census_block (char *hp, header_t hd)
+{
+  mlsize_t sz = Wosize_hd (hd);
+  int c = 0;
+
+  switch (Color_hd (hd)){
+  case Caml_white:
+    census.garbage_words += Whsize_wosize (sz);
+    break;
+  case Caml_blue:
+    census.free_words += Whsize_wosize (sz);
+    break;
+  default:
+    ++ census.live_blocks;
+    census.live_words += Whsize_wosize (sz);
+    ++ census.tag_blocks[Tag_hd (hd)];
+    census.tag_words[Tag_hd (hd)] += Whsize_wosize (sz);
+    while ((sz >> c) > 1 && c < CAML_CENSUS_SIZE_CLASSES - 1) ++ c;
+    ++ census.class_blocks[c];
+    census.class_words[c] += Whsize_wosize (sz);
+    if (dump_start != NULL) dump_block (hp, hd);
+    break;
+  }
+}
+
+/* Called when the sweep phase is over. */
+void caml_census_sweep_end (void)
+{
+  if (caml_census_state != Census_running) return;
+  caml_census_state = Census_done;
+  if (dump_start != NULL){
+    caml_memprof_do_samples (dump_sample);
+    /* Dump_trailer bytes are always left for this. */
+    dump_ptr[0] = 0;
+    dump_ptr[1] = dump_truncated;
+    dump_ptr += 2;
+  }
+}
+
+CAMLprim value caml_census_request (value v_unit)
+{
+  dump_release ();
+  caml_census_state = Census_requested;
+  return Val_unit;
+}
+
+CAMLprim value caml_census_request_dump (value v_buf, value v_ofs,
+                                         value v_len)
+{
+  intnat o = Long_val (v_ofs), l = Long_val (v_len);
+
+  if (o < 0 || l < 8 || o + l > Caml_ba_array_val (v_buf)->dim[0]){
+    caml_invalid_argument ("Census.start");
+  }
+  dump_release ();
+  dump_buf = v_buf;
+  caml_register_generational_global_root (&dump_buf);
+  dump_start = dump_ptr = (unsigned char *) Caml_ba_data_val (v_buf) + o;
+  dump_end = dump_start + l;
+  caml_census_state = Census_requested;
+  return Val_unit;
+}
+
+CAMLprim value caml_census_cancel (value v_unit)
+{
+  dump_release ();
+  caml_census_state = Census_idle;
+  return Val_unit;
+}
+
+CAMLprim value caml_census_status (value v_unit)
+{
+  return Val_int (caml_census_state);
+}
+
+static value alloc_counts (uintnat *counts, int n)
+{
+  value res = caml_alloc_tuple (n);   /* n <= Max_young_wosize */
+  int i;
+
+  for (i = 0; i < n; i++) Field (res, i) = Val_long (counts[i]);
+  return res;
+}
+
+CAMLprim value caml_census_result (value v_unit)
+{
+  CAMLparam0 ();
+  CAMLlocal5 (res, tb, tw, cb, cw);
+
+  tb = alloc_counts (census.tag_blocks, 256);
+  tw = alloc_counts (census.tag_words, 256);
+  cb = alloc_counts (census.class_blocks, CAML_CENSUS_SIZE_CLASSES);
+  cw = alloc_counts (census.class_words, CAML_CENSUS_SIZE_CLASSES);
+  res = caml_alloc_tuple (10);
+  Store_field (res, 0, Val_long (census.live_blocks));
+  Store_field (res, 1, Val_long (census.live_words));
+  Store_field (res, 2, Val_long (census.free_words));
+  Store_field (res, 3, Val_long (census.garbage_words));
+  Store_field (res, 4, tb);
+  Store_field (res, 5, tw);
+  Store_field (res, 6, cb);
+  Store_field (res, 7, cw);
+  Store_field (res, 8, Val_long (dump_start == NULL ? 0
+                                 : dump_ptr - dump_start));
+  Store_field (res, 9, Val_bool (dump_start != NULL && dump_truncated));
+  CAMLreturn (res);
+}
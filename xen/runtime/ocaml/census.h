@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef CAML_CENSUS_H
+#define CAML_CENSUS_H
+
+#include "config.h"
+#include "misc.h"
+#include "mlvalues.h"
+
+/* Census of the major heap. A requested census is taken by the
+   sweeper during the next sweep phase, so the heap is walked
+   incrementally, one sweep slice at a time, and the live blocks are
+   the ones that the preceding marking phase found reachable. */
+
+#define Census_idle 0
+#define Census_requested 1
+#define Census_running 2
+#define Census_done 3
+
+/* Size class [i] counts the blocks of 2^i to 2^(i+1)-1 words. */
+#define CAML_CENSUS_SIZE_CLASSES 32
+
+struct caml_census {
+  uintnat live_blocks, live_words;
+  uintnat free_words, garbage_words;
+  uintnat tag_blocks[256], tag_words[256];
+  uintnat class_blocks[CAML_CENSUS_SIZE_CLASSES];
+  uintnat class_words[CAML_CENSUS_SIZE_CLASSES];
+};
+
+extern int caml_census_state;
+extern void caml_census_sweep_start (void);
+extern void caml_census_block (char *hp, header_t hd);
+extern void caml_census_sweep_end (void);
+
+#endif /* CAML_CENSUS_H */
@@ -14,12 +14,15 @@
 #include <string.h>
 
 #include "config.h"
+#include "compact.h"
 #include "finalise.h"
 #include "freelist.h"
 #include "gc.h"
 #include "gc_ctrl.h"
+#include "gc_trace.h"
 #include "major_gc.h"
 #include "memory.h"
+#include "memprof.h"
 #include "mlvalues.h"
 #include "roots.h"
 #include "weak.h"
@@ -186,6 +189,7 @@ static void do_compaction (void)
        the headers (see above). */
     caml_do_roots (invert_root);
     caml_final_do_weak_roots (invert_root);
+    caml_memprof_do_roots (invert_root);
 
     ch = caml_heap_start;
     while (ch != NULL){
@@ -394,9 +398,89 @@ static void do_compaction (void)
 
 uintnat caml_percent_max;  /* used in gc_ctrl.c and memory.c */
 
+/* Pause control.  A compaction cannot be interrupted, so we bound its
+   pause by predicting it from the cost per heap word of the previous
+   ones, and skip the automatic compactions that would take longer than
+   [caml_compact_pause_budget] microseconds (0 means no limit).  Heap
+   chunks that hold no live data at all are released at the end of
+   every major cycle instead, which is cheap and often enough to bring
+   the overhead back under [caml_percent_max].  The prediction is only
+   updated by a compaction, so after [Max_skipped_compactions] skips in
+   a row we compact anyway, rather than let the heap fragment without
+   limit. */
+#define Max_skipped_compactions 8
+
+uintnat caml_compact_pause_budget = 0;
+int caml_compact_release_chunks = 1;
+struct caml_compact_stats caml_compact_stats;
+static double compact_us_per_word = 0.0;
+static uintnat compact_skipped_in_row = 0;
+
+static void record_pause (double us)
+{
+  uintnat p = us < 0.0 ? 0 : (uintnat) us;
+  int i = 0;
+
+  while (p > 1 && i < CAML_COMPACT_PAUSE_BUCKETS - 1){
+    p >>= 1;
+    ++ i;
+  }
+  ++ caml_compact_stats.pauses[i];
+  caml_compact_stats.last_pause = (uintnat) us;
+  if (caml_compact_stats.last_pause > caml_compact_stats.max_pause){
+    caml_compact_stats.max_pause = caml_compact_stats.last_pause;
+  }
+}
+
+static int chunk_is_free (char *chunk)
+{
+  char *hp = chunk, *end = chunk + Chunk_size (chunk);
+
+  while (hp < end){
+    header_t hd = Hd_hp (hp);
+    /* 0-size white blocks are fragments, not live data. */
+    if (Color_hd (hd) != Caml_blue
+        && ! (Color_hd (hd) == Caml_white && Wosize_hd (hd) == 0)){
+      return 0;
+    }
+    hp += Bhsize_hd (hd);
+  }
+  return 1;
+}
+
+/* Give the chunks that contain only free blocks back to the system,
+   keeping as much free memory as [do_compaction] would.  Return the
+   number of bytes released.  Must be called between two cycles. */
+asize_t caml_compact_release_free_chunks (void)
+{
+  char *ch, *next_chunk;
+  uintnat live, wanted;
+  asize_t released = 0;
+                                          Assert (caml_gc_phase == Phase_idle);
+  live = Wsize_bsize (caml_stat_heap_size) - caml_fl_cur_size;
+  wanted = caml_percent_free * (live / 100 + 1);
+  /* Never release the first chunk; see [caml_shrink_heap]. */
+  for (ch = Chunk_next (caml_heap_start); ch != NULL; ch = next_chunk){
+    next_chunk = Chunk_next (ch);
+    if (caml_fl_cur_size < wanted + Wsize_bsize (Chunk_size (ch))) continue;
+    if (! chunk_is_free (ch)) continue;
+    caml_fl_remove_range (ch, ch + Chunk_size (ch));
+    released += Chunk_size (ch);
+    ++ caml_compact_stats.released_chunks;
+    caml_shrink_heap (ch);
+  }
+  caml_compact_stats.released_bytes += released;
+  return released;
+}
+
 void caml_compact_heap (void)
 {
   uintnat target_words, target_size, live;
+  double heap_words = (double) Wsize_bsize (caml_stat_heap_size);
+  /* Timed with the clock of the GC trace, which also gets the pause
+     when it is enabled. */
+  uint64 start = caml_gc_trace_now (), pause_ns;
+  double pause;
 
   do_compaction ();
   /* Compaction may fail to shrink the heap to a reasonable size
@@ -435,14 +519,14 @@ void caml_compact_heap (void)
                      target_size / 1024);
 
     chunk = caml_alloc_for_heap (target_size);
-    if (chunk == NULL) return;
+    if (chunk == NULL) goto done;
     /* PR#5757: we need to make the new blocks blue, or they won't be
        recognized as free by the recompaction. */
     caml_make_free_blocks ((value *) chunk,
                            Wsize_bsize (Chunk_size (chunk)), 0, Caml_blue);
     if (caml_page_table_add (In_heap, chunk, chunk + Chunk_size (chunk)) != 0){
       caml_free_for_heap (chunk);
-      return;
+      goto done;
     }
     Chunk_next (chunk) = caml_heap_start;
     caml_heap_start = chunk;
@@ -456,6 +540,16 @@ void caml_compact_heap (void)
     Assert (Chunk_next (caml_heap_start) == NULL);
     Assert (caml_stat_heap_size == Chunk_size (chunk));
   }
+ done:
+  pause_ns = caml_gc_trace_now () - start;
+  if (caml_gc_trace_enabled){
+    caml_gc_trace_add (CAML_GC_TRACE_COMPACT, start, pause_ns,
+                       (uintnat) heap_words);
+  }
+  pause = (double) pause_ns / 1000.0;
+  record_pause (pause);
+  if (heap_words > 0.0) compact_us_per_word = pause / heap_words;
+  compact_skipped_in_row = 0;
 }
 
 void caml_compact_heap_maybe (void)
@@ -489,6 +583,18 @@ void caml_compact_heap_maybe (void)
                           ARCH_INTNAT_PRINTF_FORMAT "u%%\n",
                    (uintnat) fp);
   if (fp >= caml_percent_max){
+    /* Check the budget first: there is no point in finishing the cycle
+       for a compaction that we are not going to do. */
+    if (caml_compact_pause_budget != 0
+        && compact_skipped_in_row < Max_skipped_compactions
+        && compact_us_per_word * Wsize_bsize (caml_stat_heap_size)
+           > (double) caml_compact_pause_budget){
+      caml_gc_message (0x200, "Compaction skipped: over the pause budget.\n",
+                       0);
+      ++ caml_compact_stats.skipped;
+      ++ compact_skipped_in_row;
+      return;
+    }
     caml_gc_message (0x200, "Automatic compaction triggered.\n", 0);
     caml_finish_major_cycle ();
 
@@ -498,6 +604,8 @@ void caml_compact_heap_maybe (void)
     caml_gc_message (0x200, "Measured overhead: %"
                             ARCH_INTNAT_PRINTF_FORMAT "u%%\n",
                      (uintnat) fp);
+    /* Releasing the empty chunks may have been enough. */
+    if (fp < caml_percent_max) return;
 
     caml_compact_heap ();
   }
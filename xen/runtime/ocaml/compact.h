@@ -20,6 +20,23 @@
 
 extern void caml_compact_heap (void);
 extern void caml_compact_heap_maybe (void);
+extern asize_t caml_compact_release_free_chunks (void);
+
+/* Bucket [i] counts the compactions that took between 2^i and 2^(i+1)
+   microseconds (the first one also counts the shorter ones). */
+#define CAML_COMPACT_PAUSE_BUCKETS 32
+
+struct caml_compact_stats {
+  uintnat pauses[CAML_COMPACT_PAUSE_BUCKETS];
+  uintnat last_pause, max_pause;  /* microseconds */
+  uintnat skipped;                /* automatic compactions over budget */
+  uintnat released_chunks;
+  uintnat released_bytes;
+};
+
+extern struct caml_compact_stats caml_compact_stats;
+extern uintnat caml_compact_pause_budget;  /* microseconds, 0 = none */
+extern int caml_compact_release_chunks;
 
 
 #endif /* CAML_COMPACT_H */
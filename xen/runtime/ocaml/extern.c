@@ -17,6 +17,7 @@
 
 #include <string.h>
 #include "alloc.h"
+#include "bigarray.h"
 #include "custom.h"
 #include "fail.h"
 #include "gc.h"
@@ -703,6 +704,38 @@ CAMLexport intnat caml_output_value_to_block(value v, value flags,
   return len_res;
 }
 
+/* Marshal straight into a bigarray slice, e.g. a shared ring slot or
+   an I/O page, without going through an intermediate string. Bigarray
+   data lives outside the heap, so it cannot move under our feet. */
+
+CAMLprim value caml_output_value_to_bigarray(value buf, value ofs, value len,
+                                             value v, value flags)
+{
+  intnat o = Long_val(ofs), l = Long_val(len);
+  if (o < 0 || l < 0 || o + l > Caml_ba_array_val(buf)->dim[0])
+    caml_invalid_argument("output_value_to_bigarray");
+  /* The header is skipped over without a bounds check in extern_value */
+  if (l < 5*4)
+    caml_failwith("Marshal.to_buffer: buffer overflow");
+  return Val_long(caml_output_value_to_block(v, flags,
+                                             (char *) Caml_ba_data_val(buf) + o,
+                                             l));
+}
+
+/* Size query: the number of bytes [caml_output_value_to_bigarray]
+   would write for [v], so that callers can reserve exactly that much.
+   The value is marshaled into the usual malloc'ed chain, which is
+   thrown away. */
+
+CAMLprim value caml_output_value_size(value v, value flags)
+{
+  intnat len;
+  init_extern_output();
+  len = extern_value(v, flags);
+  free_extern_output();
+  return Val_long(len);
+}
+
 /* Functions for writing user-defined marshallers */
 
 CAMLexport void caml_serialize_int_1(int i)
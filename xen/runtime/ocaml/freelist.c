@@ -63,9 +63,311 @@ static char *beyond = NULL;
 
 #define Policy_next_fit 0
 #define Policy_first_fit 1
+#define Policy_best_fit 2
 uintnat caml_allocation_policy = Policy_next_fit;
 #define policy caml_allocation_policy
 
+static char *last_fragment;
+
+/* Best-fit policy.
+
+   The free blocks are kept in size-segregated, doubly-linked lists
+   instead of the address-ordered list: one list per size for the
+   small blocks, and for the larger ones four lists per power of two.
+   A bitmap of the non-empty lists finds the smallest class that can
+   satisfy a request in a few instructions.  Within a class of large
+   blocks, the smallest block that fits is chosen (looking at no more
+   than [BF_SCAN_MAX] candidates).
+
+   Blocks of size 1 cannot hold the back link.  They are left white,
+   like the 0-size fragments, and picked up again by the next sweep.
+
+   Without the address order, [caml_fl_merge] is only used to
+   coalesce: it is the last free block that the sweeper has seen, and
+   the next free block is merged into it when they are adjacent.
+   [Fl_head] means "none".
+*/
+
+#define BF_MIN_WOSZ 2
+#define BF_NUM_SMALL 16
+#define BF_LOG_SMALL 4            /* log2 (BF_NUM_SMALL) */
+#define BF_LOG_SUB 2
+#define BF_SUBCLASSES (1 << BF_LOG_SUB)
+#define BF_NUM_CLASSES \
+  (BF_NUM_SMALL + 1 + (8 * sizeof (mlsize_t) - BF_LOG_SMALL) * BF_SUBCLASSES)
+#define BF_WORD_BITS (8 * sizeof (uintnat))
+#define BF_MAP_WORDS ((BF_NUM_CLASSES + BF_WORD_BITS - 1) / BF_WORD_BITS)
+#define BF_SCAN_MAX 32
+
+#define Prev(b) (((char **) (b))[1])
+
+static char *bf_head [BF_NUM_CLASSES];
+static uintnat bf_map [BF_MAP_WORDS];
+
+static int bf_log2 (mlsize_t x)
+{
+#ifdef __GNUC__
+  return 8 * sizeof (unsigned long) - 1 - __builtin_clzl ((unsigned long) x);
+#else
+  int l = 0;
+  while (x >>= 1) ++ l;
+  return l;
+#endif
+}
+
+static int bf_ctz (uintnat x)
+{
+#ifdef __GNUC__
+  return __builtin_ctzl ((unsigned long) x);
+#else
+  int n = 0;
+  while ((x & 1) == 0){ x >>= 1; ++ n; }
+  return n;
+#endif
+}
+
+static int bf_class (mlsize_t wosz)
+{
+  int l;
+  if (wosz <= BF_NUM_SMALL) return (int) wosz;
+  l = bf_log2 (wosz);
+  return BF_NUM_SMALL + 1 + (l - BF_LOG_SMALL) * BF_SUBCLASSES
+         + (int) ((wosz >> (l - BF_LOG_SUB)) & (BF_SUBCLASSES - 1));
+}
+
+/* The first non-empty class at or above [c], or -1. */
+static int bf_next_class (int c)
+{
+  int w;
+  uintnat bits;
+
+  if (c >= BF_NUM_CLASSES) return -1;
+  w = c / BF_WORD_BITS;
+  bits = bf_map[w] & (~ (uintnat) 0 << (c % BF_WORD_BITS));
+  while (bits == 0){
+    if (++ w >= BF_MAP_WORDS) return -1;
+    bits = bf_map[w];
+  }
+  return w * BF_WORD_BITS + bf_ctz (bits);
+}
+
+static void bf_insert (char *bp)
+{
+  int c = bf_class (Wosize_bp (bp));
+                                         Assert (Wosize_bp (bp) >= BF_MIN_WOSZ);
+  Next (bp) = bf_head[c];
+  Prev (bp) = NULL;
+  if (bf_head[c] != NULL) Prev (bf_head[c]) = bp;
+  bf_head[c] = bp;
+  bf_map[c / BF_WORD_BITS] |= (uintnat) 1 << (c % BF_WORD_BITS);
+}
+
+/* Must be called before the header of [bp] is changed. */
+static void bf_remove (char *bp)
+{
+  int c = bf_class (Wosize_bp (bp));
+
+  if (Prev (bp) == NULL){
+                                                 Assert (bf_head[c] == bp);
+    bf_head[c] = Next (bp);
+    if (bf_head[c] == NULL){
+      bf_map[c / BF_WORD_BITS] &= ~ ((uintnat) 1 << (c % BF_WORD_BITS));
+    }
+  }else{
+    Next (Prev (bp)) = Next (bp);
+  }
+  if (Next (bp) != NULL) Prev (Next (bp)) = Prev (bp);
+}
+
+static void bf_reset (void)
+{
+  memset (bf_head, 0, sizeof (bf_head));
+  memset (bf_map, 0, sizeof (bf_map));
+}
+
+/* Turn a block that is too small to be linked into a white remnant.
+   Its field (if any) must not look like a pointer to the compactor. */
+static void bf_make_remnant (char *bp, mlsize_t wosz)
+{
+  mlsize_t i;
+  for (i = 0; i < wosz; i++) Field ((value) bp, i) = Val_unit;
+  Hd_bp (bp) = Make_header (wosz, 0, Caml_white);
+}
+
+/* Allocate [wo_sz] words from the free block [bp], right-justified as
+   in [allocate_block], and put the rest back in the right class. */
+static char *bf_split (char *bp, mlsize_t wo_sz)
+{
+  header_t h = Hd_bp (bp);
+  mlsize_t wh_sz = Whsize_wosize (wo_sz);
+  mlsize_t rem = Whsize_hd (h) - wh_sz;
+                                                Assert (Whsize_hd (h) >= wh_sz);
+  bf_remove (bp);
+  if (rem >= Whsize_wosize (BF_MIN_WOSZ)){
+    caml_fl_cur_size -= wh_sz;
+    Hd_bp (bp) = Make_header (Wosize_whsize (rem), 0, Caml_blue);
+    bf_insert (bp);
+  }else{
+    caml_fl_cur_size -= Whsize_hd (h);
+    if (caml_fl_merge == bp) caml_fl_merge = Fl_head;
+    /* If [rem] is 0, this header is overwritten by the caller. */
+    if (rem > 0) bf_make_remnant (bp, Wosize_whsize (rem));
+  }
+  return bp + Bosize_hd (h) - Bsize_wsize (wh_sz);
+}
+
+static char *bf_allocate (mlsize_t wo_sz)
+{
+  int c, n;
+  char *cur, *best = NULL;
+
+  c = bf_class (wo_sz < BF_MIN_WOSZ ? BF_MIN_WOSZ : wo_sz);
+  /* The blocks of a small class all have the requested size.  Those of
+     a large class may be too small, so look for the best one that fits
+     before moving on to the next class. */
+  if (c > BF_NUM_SMALL){
+    for (cur = bf_head[c], n = 0; cur != NULL && n < BF_SCAN_MAX;
+         cur = Next (cur), n++){
+      if (Wosize_bp (cur) >= wo_sz
+          && (best == NULL || Wosize_bp (cur) < Wosize_bp (best))){
+        best = cur;
+        if (Wosize_bp (cur) == wo_sz) break;
+      }
+    }
+    if (best != NULL) return bf_split (best, wo_sz);
+    ++ c;
+  }
+  c = bf_next_class (c);
+  if (c < 0) return NULL;
+  best = bf_head[c];
+  if (c > BF_NUM_SMALL){
+    for (cur = Next (best), n = 1; cur != NULL && n < BF_SCAN_MAX;
+         cur = Next (cur), n++){
+      if (Wosize_bp (cur) < Wosize_bp (best)) best = cur;
+    }
+  }
+  return bf_split (best, wo_sz);
+}
+
+/* If [bp] directly follows [last_fragment], extend it backwards over
+   the fragment and give it colour [color].  Return the new block. */
+static char *bf_absorb_fragment (char *bp, color_t color)
+{
+  char *lf = last_fragment;
+  mlsize_t wosz;
+
+  /* Blocks are swept in address order: if [bp] does not follow the
+     fragment, nothing will. */
+  last_fragment = NULL;
+  if (lf == NULL || lf + Bsize_wsize (Wosize_bp (lf)) != Hp_bp (bp)) return bp;
+  wosz = Wosize_bp (lf) + Whsize_bp (bp);
+  if (wosz > Max_wosize) return bp;
+  caml_fl_cur_size += Whsize_bp (lf);
+  Hd_bp (lf) = Make_header (wosz, 0, color);
+  return lf;
+}
+
+/* [bp] is a free block the sweeper has just reached, either white and
+   not yet linked ([linked] is 0) or already in a list.  Merge it into
+   [caml_fl_merge] if they are adjacent, otherwise link it and make it
+   the new [caml_fl_merge]. */
+static void bf_coalesce (char *bp, int linked)
+{
+  char *prev = caml_fl_merge;
+  mlsize_t wosz = Wosize_bp (bp);
+
+  if (prev != Fl_head && prev + Bsize_wsize (Wosize_bp (prev)) == Hp_bp (bp)
+      && Wosize_bp (prev) + Whsize_wosize (wosz) <= Max_wosize){
+    if (linked) bf_remove (bp);
+    bf_remove (prev);
+    Hd_bp (prev) = Make_header (Wosize_bp (prev) + Whsize_wosize (wosz), 0,
+                                Caml_blue);
+    bf_insert (prev);
+#ifdef DEBUG
+    Hd_bp (bp) = Debug_free_major;
+#endif
+  }else if (wosz >= BF_MIN_WOSZ){
+    if (! linked){
+      Hd_bp (bp) = Make_header (wosz, 0, Caml_blue);
+      bf_insert (bp);
+    }
+    caml_fl_merge = bp;
+  }else{
+                                                             Assert (!linked);
+    bf_make_remnant (bp, wosz);
+    caml_fl_cur_size -= Whsize_wosize (wosz);
+    last_fragment = bp;
+  }
+}
+
+static char *bf_merge_block (char *bp)
+{
+  header_t hd = Hd_bp (bp);
+  char *adj = bp + Bosize_hd (hd);
+
+  caml_fl_cur_size += Whsize_hd (hd);
+#ifdef DEBUG
+  caml_set_fields (bp, 0, Debug_free_major);
+#endif
+  bp = bf_absorb_fragment (bp, Caml_white);
+  bf_coalesce (bp, 0);
+  return adj;
+}
+
+static void bf_merge_free_block (char *bp)
+{
+  char *nbp = bf_absorb_fragment (bp, Caml_blue);
+
+  if (nbp != bp){
+    bf_remove (bp);
+    bf_insert (nbp);
+  }
+  bf_coalesce (nbp, 1);
+}
+
+static void bf_add_blocks (char *bp)
+{
+  char *next;
+
+  while (bp != NULL){
+                                             Assert (Color_hp (Hp_bp (bp))
+                                                     == Caml_blue);
+    next = Next (bp);
+    if (Wosize_bp (bp) >= BF_MIN_WOSZ){
+      caml_fl_cur_size += Whsize_bp (bp);
+      bf_insert (bp);
+    }else{
+      bf_make_remnant (bp, Wosize_bp (bp));
+    }
+    bp = next;
+  }
+}
+
+#ifdef DEBUG
+static void bf_check (void)
+{
+  int c;
+  char *cur;
+  uintnat size_found = 0;
+  int merge_found = 0;
+
+  for (c = 0; c < BF_NUM_CLASSES; c++){
+    Assert ((bf_head[c] != NULL)
+            == ((bf_map[c / BF_WORD_BITS] >> (c % BF_WORD_BITS)) & 1));
+    for (cur = bf_head[c]; cur != NULL; cur = Next (cur)){
+      Assert (Is_in_heap (cur));
+      Assert (Color_hp (Hp_bp (cur)) == Caml_blue);
+      Assert (bf_class (Wosize_bp (cur)) == c);
+      Assert (Next (cur) == NULL || Prev (Next (cur)) == cur);
+      if (cur == caml_fl_merge) merge_found = 1;
+      size_found += Whsize_bp (cur);
+    }
+  }
+  Assert (merge_found || caml_fl_merge == Fl_head);
+  Assert (size_found == caml_fl_cur_size);
+}
+#endif
+
 #ifdef DEBUG
 static void fl_check (void)
 {
@@ -74,6 +376,10 @@ static void fl_check (void)
   uintnat size_found = 0;
   int sz = 0;
 
+  if (policy == Policy_best_fit){
+    bf_check ();
+    return;
+  }
   prev = Fl_head;
   cur = Next (prev);
   while (cur != NULL){
@@ -328,6 +634,9 @@ char *caml_fl_allocate (mlsize_t wo_sz)
   }
   break;
 
+  case Policy_best_fit:
+    return bf_allocate (wo_sz);
+
   default:
     Assert (0);   /* unknown policy */
     break;
@@ -335,8 +644,6 @@ char *caml_fl_allocate (mlsize_t wo_sz)
   return NULL;  /* NOT REACHED */
 }
 
-static char *last_fragment;
-
 void caml_fl_init_merge (void)
 {
   last_fragment = NULL;
@@ -368,6 +675,9 @@ void caml_fl_reset (void)
   case Policy_first_fit:
     truncate_flp (Fl_head);
     break;
+  case Policy_best_fit:
+    bf_reset ();
+    break;
   default:
     Assert (0);
     break;
@@ -384,6 +694,8 @@ char *caml_fl_merge_block (char *bp)
   header_t hd = Hd_bp (bp);
   mlsize_t prev_wosz;
 
+  if (policy == Policy_best_fit) return bf_merge_block (bp);
+
   caml_fl_cur_size += Whsize_hd (hd);
 
 #ifdef DEBUG
@@ -465,8 +777,22 @@ char *caml_fl_merge_block (char *bp)
    terminated by NULL, and field 1 of the first block must point to
    the last block.
 */
+/* This is called by the sweeper on the blocks that are already free. */
+void caml_fl_merge_free_block (char *bp)
+{
+  if (policy == Policy_best_fit){
+    bf_merge_free_block (bp);
+  }else{
+    caml_fl_merge = bp;
+  }
+}
+
 void caml_fl_add_blocks (char *bp)
 {
+  if (policy == Policy_best_fit){
+    bf_add_blocks (bp);
+    return;
+  }
                                                    Assert (fl_last != NULL);
                                             Assert (Next (fl_last) == NULL);
   caml_fl_cur_size += Whsize_bp (bp);
@@ -502,6 +828,44 @@ void caml_fl_add_blocks (char *bp)
   }
 }
 
+/* Remove from the free list all the blocks between [start] and [end],
+   which must all be free.  This is called before a heap chunk that
+   holds no live data is given back to the system. */
+void caml_fl_remove_range (char *start, char *end)
+{
+  char *prev, *cur, *hp;
+
+  if (policy == Policy_best_fit){
+    for (hp = start; hp < end; hp += Bhsize_hp (hp)){
+      if (Color_hp (hp) != Caml_blue) continue;
+      cur = Bp_hp (hp);
+      bf_remove (cur);
+      caml_fl_cur_size -= Whsize_bp (cur);
+      if (caml_fl_merge == cur) caml_fl_merge = Fl_head;
+    }
+    if (last_fragment >= start && last_fragment < end) last_fragment = NULL;
+    return;
+  }
+  prev = Fl_head;
+  cur = Next (prev);
+  while (cur != NULL && cur < start){
+    prev = cur;
+    cur = Next (prev);
+  }
+  while (cur != NULL && cur < end){
+    caml_fl_cur_size -= Whsize_bp (cur);
+    if (fl_prev == cur) fl_prev = prev;
+    if (caml_fl_merge == cur) caml_fl_merge = prev;
+    cur = Next (cur);
+  }
+  Next (prev) = cur;
+#ifdef DEBUG
+  fl_last = NULL;
+#endif
+  if (policy == Policy_first_fit) truncate_flp (prev);
+  if (last_fragment >= start && last_fragment < end) last_fragment = NULL;
+}
+
 /* Cut a block of memory into Max_wosize pieces, give them headers,
    and optionally merge them into the free list.
    arguments:
@@ -529,8 +893,48 @@ void caml_make_free_blocks (value *p, mlsize_t size, int do_merge, int color)
   }
 }
 
+/* Best-fit and the other two policies do not share their free-list
+   structure.  When switching between them, rebuild it from the blue
+   blocks of the heap, in address order.  [caml_fl_merge] must remain
+   the last free block before the sweep pointer. */
+static void fl_rebuild (void)
+{
+  char *ch, *hp, *bp, *prev = Fl_head;
+
+  Next (Fl_head) = NULL;
+  bf_reset ();
+  fl_prev = Fl_head;
+  flp_size = 0;
+  beyond = NULL;
+  caml_fl_merge = Fl_head;
+  last_fragment = NULL;
+  for (ch = caml_heap_start; ch != NULL; ch = Chunk_next (ch)){
+    for (hp = ch; hp < ch + Chunk_size (ch); hp += Bhsize_hp (hp)){
+      if (Color_hp (hp) != Caml_blue) continue;
+      bp = Bp_hp (hp);
+      if (policy == Policy_best_fit){
+        if (Wosize_bp (bp) < BF_MIN_WOSZ){
+          caml_fl_cur_size -= Whsize_bp (bp);
+          bf_make_remnant (bp, Wosize_bp (bp));
+          continue;
+        }
+        bf_insert (bp);
+      }else{
+        Next (prev) = bp;
+        prev = bp;
+      }
+      if (caml_gc_phase == Phase_sweep && hp < caml_gc_sweep_hp){
+        caml_fl_merge = bp;
+      }
+    }
+  }
+  if (policy != Policy_best_fit) Next (prev) = NULL;
+}
+
 void caml_set_allocation_policy (uintnat p)
 {
+  uintnat oldpolicy = policy;
+
   switch (p){
   case Policy_next_fit:
     fl_prev = Fl_head;
@@ -541,7 +945,13 @@ void caml_set_allocation_policy (uintnat p)
     beyond = NULL;
     policy = p;
     break;
+  case Policy_best_fit:
+    policy = p;
+    break;
   default:
     break;
   }
+  if ((oldpolicy == Policy_best_fit) != (policy == Policy_best_fit)){
+    fl_rebuild ();
+  }
 }
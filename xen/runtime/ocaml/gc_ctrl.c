@@ -406,6 +406,12 @@ CAMLprim value caml_gc_set(value v)
     caml_gc_message (0x20, "New minor heap size: %luk bytes\n",
                      newminsize/1024);
     caml_set_minor_heap_size (newminsize);
+    /* An explicit size wins over the adaptive sizing. */
+    if (caml_minor_heap_adaptive){
+      caml_minor_heap_adaptive = 0;
+      caml_gc_message (0x20, "Adaptive minor heap sizing turned off\n", 0);
+    }
+    caml_minor_heap_reset_adapt ();
   }
   return Val_unit;
 }
@@ -475,6 +481,100 @@ CAMLprim value caml_gc_compaction(value v)
   return Val_unit;
 }
 
+CAMLprim value caml_gc_compaction_stats(value v)
+{
+  CAMLparam0 ();   /* v is ignored */
+  CAMLlocal2 (res, pauses);
+  struct caml_compact_stats st = caml_compact_stats;
+  intnat cpct = caml_stat_compactions;
+  int i;
+
+  pauses = caml_alloc_tuple (CAML_COMPACT_PAUSE_BUCKETS);
+  for (i = 0; i < CAML_COMPACT_PAUSE_BUCKETS; i++){
+    Field (pauses, i) = Val_long (st.pauses[i]);
+  }
+  res = caml_alloc_tuple (7);
+  Store_field (res, 0, Val_long (cpct));
+  Store_field (res, 1, Val_long (st.skipped));
+  Store_field (res, 2, Val_long (st.last_pause));
+  Store_field (res, 3, Val_long (st.max_pause));
+  Store_field (res, 4, pauses);
+  Store_field (res, 5, Val_long (st.released_chunks));
+  Store_field (res, 6, Val_long (st.released_bytes));
+  CAMLreturn (res);
+}
+
+CAMLprim value caml_gc_get_compaction_budget(value v)
+{
+  return Val_long (caml_compact_pause_budget);
+}
+
+CAMLprim value caml_gc_set_compaction_budget(value v)
+{
+  intnat us = Long_val (v);
+  caml_compact_pause_budget = us < 0 ? 0 : us;
+  caml_gc_message (0x20, "New compaction pause budget: %luus\n",
+                   caml_compact_pause_budget);
+  return Val_unit;
+}
+
+CAMLprim value caml_gc_set_release_chunks(value v)
+{
+  caml_compact_release_chunks = Bool_val (v);
+  return Val_unit;
+}
+
+CAMLprim value caml_gc_release_free_chunks(value v)
+{                                                    Assert (v == Val_unit);
+  uintnat before = caml_compact_stats.released_bytes;
+
+  caml_gc_message (0x10, "Release of free heap chunks requested\n", 0);
+  caml_empty_minor_heap ();
+  caml_finish_major_cycle ();   /* may already release some */
+  caml_compact_release_free_chunks ();
+  caml_final_do_calls ();
+  return Val_long (caml_compact_stats.released_bytes - before);
+}
+
+CAMLprim value caml_gc_minor_heap_stats(value v)
+{
+  CAMLparam0 ();   /* v is ignored */
+  CAMLlocal2 (res, survival);
+  struct caml_minor_heap_stats st = caml_minor_heap_stats;
+
+  survival = caml_copy_double (st.survival);
+  res = caml_alloc_tuple (7);
+  Store_field (res, 0, Val_bool (caml_minor_heap_adaptive));
+  Store_field (res, 1, Val_long (caml_minor_heap_wsz_min));
+  Store_field (res, 2, Val_long (caml_minor_heap_wsz_max));
+  Store_field (res, 3, Val_long (Wsize_bsize (caml_minor_heap_size)));
+  Store_field (res, 4, Val_long (st.grows));
+  Store_field (res, 5, Val_long (st.shrinks));
+  Store_field (res, 6, survival);
+  CAMLreturn (res);
+}
+
+CAMLprim value caml_gc_set_minor_heap_bounds(value vmin, value vmax)
+{
+  uintnat lo = norm_minsize (Long_val (vmin));
+  uintnat hi = norm_minsize (Long_val (vmax));
+
+  if (hi < lo) hi = lo;
+  caml_minor_heap_wsz_min = lo;
+  caml_minor_heap_wsz_max = hi;
+  caml_gc_message (0x20, "New minor heap bounds: %luk words", lo / 1024);
+  caml_gc_message (0x20, " .. %luk words\n", hi / 1024);
+  caml_minor_heap_reset_adapt ();
+  return Val_unit;
+}
+
+CAMLprim value caml_gc_set_minor_heap_adaptive(value v)
+{
+  caml_minor_heap_adaptive = Bool_val (v);
+  caml_minor_heap_reset_adapt ();
+  return Val_unit;
+}
+
 void caml_init_gc (uintnat minor_size, uintnat major_size,
                    uintnat major_incr, uintnat percent_fr,
                    uintnat percent_m)
@@ -489,6 +589,7 @@ void caml_init_gc (uintnat minor_size, uintnat major_size,
   caml_percent_free = norm_pfree (percent_fr);
   caml_percent_max = norm_pmax (percent_m);
   caml_init_major_heap (major_heap_size);
+  caml_minor_heap_reset_adapt ();
   caml_gc_message (0x20, "Initial minor heap size: %luk bytes\n",
                    caml_minor_heap_size / 1024);
   caml_gc_message (0x20, "Initial major heap size: %luk bytes\n",
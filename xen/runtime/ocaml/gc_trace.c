@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* GC pause tracing, see gc_trace.h. */
+
+#include <string.h>
+#include "config.h"
+#include <mini-os/os.h>
+#include <mini-os/time.h>
+#include "alloc.h"
+#include "gc_trace.h"
+#include "memory.h"
+#include "misc.h"
+#include "mlvalues.h"
+
+int caml_gc_trace_enabled = 0;
+
+static struct caml_gc_trace_hist hists[CAML_GC_TRACE_PHASES];
+static struct caml_gc_trace_event events[CAML_GC_TRACE_EVENTS];
+static uintnat events_head = 0;   /* total number of events recorded */
+
+static const char *phase_names[CAML_GC_TRACE_PHASES] =
+  { "minor", "mark", "sweep", "compact" };
+
+uint64 caml_gc_trace_now (void)
+{
+  return NOW ();
+}
+
+static int bucket_of (uint64 ns)
+{
+  int i;
+#ifdef __GNUC__
+  i = ns < 2 ? 0 : 63 - __builtin_clzll (ns);
+#else
+  for (i = 0; ns > 1; i++) ns >>= 1;
+#endif
+  return i < CAML_GC_TRACE_BUCKETS ? i : CAML_GC_TRACE_BUCKETS - 1;
+}
+
+void caml_gc_trace_record (int phase, uint64 start, uintnat work)
+{
+  caml_gc_trace_add (phase, start, caml_gc_trace_now () - start, work);
+}
+
+void caml_gc_trace_add (int phase, uint64 start, uint64 d, uintnat work)
+{
+  struct caml_gc_trace_hist *h = &hists[phase];
+  struct caml_gc_trace_event *e =
+    &events[events_head++ & (CAML_GC_TRACE_EVENTS - 1)];
+
+  ++ h->count;
+  h->total += d;
+  if (d > h->max) h->max = d;
+  ++ h->buckets[bucket_of (d)];
+  e->start = start;
+  e->duration = d;
+  e->work = work;
+  e->phase = phase;
+}
+
+static void reset (void)
+{
+  memset (hists, 0, sizeof (hists));
+  events_head = 0;
+}
+
+/* Copy the recent events, oldest first, into [buf]. We take a copy
+   because allocating the result may trigger a traced collection. */
+static uintnat copy_events (struct caml_gc_trace_event *buf)
+{
+  uintnat n, i, first;
+
+  n = events_head < CAML_GC_TRACE_EVENTS ? events_head : CAML_GC_TRACE_EVENTS;
+  first = events_head - n;
+  for (i = 0; i < n; i++){
+    buf[i] = events[(first + i) & (CAML_GC_TRACE_EVENTS - 1)];
+  }
+  return n;
+}
+
+#define Us(ns) ((unsigned long) ((ns) / 1000))
+
+void caml_gc_trace_dump (void)
+{
+  static struct caml_gc_trace_event buf[CAML_GC_TRACE_EVENTS];
+  uintnat n, i;
+  int p, b;
+
+  printk ("GC trace (%s):\n", caml_gc_trace_enabled ? "enabled" : "disabled");
+  for (p = 0; p < CAML_GC_TRACE_PHASES; p++){
+    struct caml_gc_trace_hist *h = &hists[p];
+    if (h->count == 0) continue;
+    printk ("  %-8s %lu pauses, total %luus, mean %luus, max %luus\n",
+            phase_names[p], (unsigned long) h->count, Us (h->total),
+            Us (h->total / h->count), Us (h->max));
+    for (b = 0; b < CAML_GC_TRACE_BUCKETS; b++){
+      if (h->buckets[b] == 0) continue;
+      printk ("    < %luns: %lu\n", (unsigned long) 1 << (b + 1),
+              (unsigned long) h->buckets[b]);
+    }
+  }
+  n = copy_events (buf);
+  if (n > 16){
+    memmove (buf, buf + n - 16, 16 * sizeof (buf[0]));
+    n = 16;
+  }
+  for (i = 0; i < n; i++){
+    printk ("  at %luus: %-8s %luus, %lu words\n", Us (buf[i].start),
+            phase_names[buf[i].phase], Us (buf[i].duration),
+            (unsigned long) buf[i].work);
+  }
+}
+
+#define Seconds(ns) ((double) (ns) * 1e-9)
+
+CAMLprim value caml_gc_trace_set_enabled (value v)
+{
+  caml_gc_trace_enabled = Bool_val (v);
+  return Val_unit;
+}
+
+CAMLprim value caml_gc_trace_reset (value v)
+{
+  reset ();
+  return Val_unit;
+}
+
+CAMLprim value caml_gc_trace_histogram (value v_phase)
+{
+  CAMLparam1 (v_phase);
+  CAMLlocal4 (res, buckets, total, max);
+  struct caml_gc_trace_hist h = hists[Int_val (v_phase)];
+  int i;
+
+  buckets = caml_alloc_tuple (CAML_GC_TRACE_BUCKETS);
+  for (i = 0; i < CAML_GC_TRACE_BUCKETS; i++){
+    Field (buckets, i) = Val_long (h.buckets[i]);
+  }
+  total = caml_copy_double (Seconds (h.total));
+  max = caml_copy_double (Seconds (h.max));
+  res = caml_alloc_tuple (4);
+  Store_field (res, 0, Val_long (h.count));
+  Store_field (res, 1, total);
+  Store_field (res, 2, max);
+  Store_field (res, 3, buckets);
+  CAMLreturn (res);
+}
+
+CAMLprim value caml_gc_trace_events (value v)
+{
+  CAMLparam0 ();   /* v is ignored */
+  CAMLlocal4 (res, ev, start, duration);
+  static struct caml_gc_trace_event buf[CAML_GC_TRACE_EVENTS];
+  uintnat n, i;
+
+  n = copy_events (buf);
+  res = caml_alloc_tuple (n);   /* [||] when n = 0 */
+  for (i = 0; i < n; i++){
+    start = caml_copy_double (Seconds (buf[i].start));
+    duration = caml_copy_double (Seconds (buf[i].duration));
+    ev = caml_alloc_tuple (4);
+    Store_field (ev, 0, Val_int (buf[i].phase));
+    Store_field (ev, 1, start);
+    Store_field (ev, 2, duration);
+    Store_field (ev, 3, Val_long (buf[i].work));
+    Store_field (res, i, ev);
+  }
+  CAMLreturn (res);
+}
+
+CAMLprim value caml_gc_trace_console (value v)
+{
+  caml_gc_trace_dump ();
+  return Val_unit;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef CAML_GC_TRACE_H
+#define CAML_GC_TRACE_H
+
+#include "config.h"
+#include "misc.h"
+
+/* Tracing of GC pauses. Every traced pause is timed with the
+   monotonic clock, counted in a per-phase histogram and appended to
+   a small ring of recent events. Tracing is off until
+   [caml_gc_trace_enabled] is set, and then costs two clock reads and a
+   few stores per pause. */
+
+#define CAML_GC_TRACE_MINOR 0
+#define CAML_GC_TRACE_MARK 1
+#define CAML_GC_TRACE_SWEEP 2
+#define CAML_GC_TRACE_COMPACT 3
+#define CAML_GC_TRACE_PHASES 4
+
+/* Bucket [i] counts the pauses that took between 2^i and 2^(i+1)
+   nanoseconds (the first one also counts the shorter ones). */
+#define CAML_GC_TRACE_BUCKETS 48
+
+/* Number of recent events kept; must be a power of 2. */
+#define CAML_GC_TRACE_EVENTS 256
+
+struct caml_gc_trace_hist {
+  uintnat count;
+  uint64 total, max;              /* nanoseconds */
+  uintnat buckets[CAML_GC_TRACE_BUCKETS];
+};
+
+struct caml_gc_trace_event {
+  uint64 start, duration;         /* nanoseconds */
+  uintnat work;                   /* words */
+  int phase;
+};
+
+extern int caml_gc_trace_enabled;
+extern uint64 caml_gc_trace_now (void);
+extern void caml_gc_trace_record (int phase, uint64 start, uintnat work);
+/* Same, for a pause whose duration [d] the caller has measured already. */
+extern void caml_gc_trace_add (int phase, uint64 start, uint64 d,
+                               uintnat work);
+extern void caml_gc_trace_dump (void);
+
+/* [CAML_GC_TRACE_BEGIN (t)] declares [t] and reads the clock into it if
+   tracing is enabled; [CAML_GC_TRACE_END (t, phase, work)] records the
+   pause that started at [t]. */
+#define CAML_GC_TRACE_BEGIN(t) \
+  uint64 t = caml_gc_trace_enabled ? caml_gc_trace_now () : 0
+
+#define CAML_GC_TRACE_END(t, phase, work) do{ \
+    if (t != 0) caml_gc_trace_record ((phase), (t), (work)); \
+  }while(0)
+
+#endif /* CAML_GC_TRACE_H */
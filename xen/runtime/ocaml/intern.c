@@ -18,6 +18,7 @@
 #include <string.h>
 #include <stdio.h>
 #include "alloc.h"
+#include "bigarray.h"
 #include "callback.h"
 #include "custom.h"
 #include "fail.h"
@@ -711,6 +712,23 @@ CAMLexport value caml_input_value_from_block(char * data, intnat len)
   return obj;
 }
 
+/* Unmarshal in place from a bigarray slice. The slice is not copied,
+   so the caller must not modify it until this returns. */
+
+CAMLprim value caml_input_value_from_bigarray(value buf, value ofs, value len)
+{
+  /* Keep [buf] alive: intern_alloc may trigger a GC, and its finaliser
+     would release the data we are reading from. */
+  CAMLparam1 (buf);
+  intnat o = Long_val(ofs), l = Long_val(len);
+  if (o < 0 || l < 0 || o + l > Caml_ba_array_val(buf)->dim[0])
+    caml_invalid_argument("input_value_from_bigarray");
+  if (l < 5*4)
+    caml_failwith("input_value_from_bigarray: truncated object");
+  CAMLreturn (caml_input_value_from_block((char *) Caml_ba_data_val(buf) + o,
+                                          l));
+}
+
 CAMLprim value caml_marshal_data_size(value buff, value ofs)
 {
   uint32 magic;
@@ -13,6 +13,7 @@
 
 #include <limits.h>
 
+#include "census.h"
 #include "compact.h"
 #include "custom.h"
 #include "config.h"
@@ -21,7 +22,9 @@
 #include "freelist.h"
 #include "gc.h"
 #include "gc_ctrl.h"
+#include "gc_trace.h"
 #include "major_gc.h"
+#include "memprof.h"
 #include "misc.h"
 #include "mlvalues.h"
 #include "roots.h"
@@ -42,8 +45,6 @@ uintnat caml_dependent_size, caml_dependent_allocated;
 double caml_extra_heap_resources;
 uintnat caml_fl_size_at_phase_change = 0;
 
-extern char *caml_fl_merge;  /* Defined in freelist.c. */
-
 static char *markhp, *chunk, *limit;
 
 int caml_gc_subphase;     /* Subphase_{main,weak1,weak2,final} */
@@ -234,6 +235,7 @@ static void mark_slice (intnat work)
           /* Subphase_weak1 is done.
              Handle finalised values and start removing dead weak arrays. */
           gray_vals_cur = gray_vals_ptr;
+          caml_memprof_major_update ();
           caml_final_update ();
           gray_vals_ptr = gray_vals_cur;
           caml_gc_subphase = Subphase_weak2;
@@ -272,6 +274,7 @@ static void mark_slice (intnat work)
         limit = chunk + Chunk_size (chunk);
         work = 0;
         caml_fl_size_at_phase_change = caml_fl_cur_size;
+        caml_census_sweep_start ();
       }
         break;
       default: Assert (0);
@@ -291,6 +294,7 @@ static void sweep_slice (intnat work)
     if (caml_gc_sweep_hp < limit){
       hp = caml_gc_sweep_hp;
       hd = Hd_hp (hp);
+      if (caml_census_state == Census_running) caml_census_block (hp, hd);
       work -= Whsize_hd (hd);
       caml_gc_sweep_hp += Bhsize_hd (hd);
       switch (Color_hd (hd)){
@@ -303,7 +307,7 @@ static void sweep_slice (intnat work)
         break;
       case Caml_blue:
         /* Only the blocks of the free-list are blue.  See [freelist.c]. */
-        caml_fl_merge = Bp_hp (hp);
+        caml_fl_merge_free_block (Bp_hp (hp));
         break;
       default:          /* gray or black */
         Assert (Color_hd (hd) == Caml_black);
@@ -318,6 +322,8 @@ static void sweep_slice (intnat work)
         ++ caml_stat_major_collections;
         work = 0;
         caml_gc_phase = Phase_idle;
+        caml_census_sweep_end ();
+        if (caml_compact_release_chunks) caml_compact_release_free_chunks ();
       }else{
         caml_gc_sweep_hp = chunk;
         limit = chunk + Chunk_size (chunk);
@@ -411,11 +417,15 @@ intnat caml_major_collection_slice (intnat howmuch)
   caml_gc_message (0x40, "computed work = %ld words\n", computed_work);
   if (howmuch == 0) howmuch = computed_work;
   if (caml_gc_phase == Phase_mark){
+    CAML_GC_TRACE_BEGIN (trace_start);
     mark_slice (howmuch);
+    CAML_GC_TRACE_END (trace_start, CAML_GC_TRACE_MARK, howmuch);
     caml_gc_message (0x02, "!", 0);
   }else{
+    CAML_GC_TRACE_BEGIN (trace_start);
     Assert (caml_gc_phase == Phase_sweep);
     sweep_slice (howmuch);
+    CAML_GC_TRACE_END (trace_start, CAML_GC_TRACE_SWEEP, howmuch);
     caml_gc_message (0x02, "$", 0);
   }
 
@@ -437,10 +447,19 @@ intnat caml_major_collection_slice (intnat howmuch)
 */
 void caml_finish_major_cycle (void)
 {
+  CAML_GC_TRACE_BEGIN (trace_start);
+
   if (caml_gc_phase == Phase_idle) start_cycle ();
-  while (caml_gc_phase == Phase_mark) mark_slice (LONG_MAX);
+  if (caml_gc_phase == Phase_mark){
+    while (caml_gc_phase == Phase_mark) mark_slice (LONG_MAX);
+    CAML_GC_TRACE_END (trace_start, CAML_GC_TRACE_MARK,
+                       Wsize_bsize (caml_stat_heap_size));
+    if (trace_start != 0) trace_start = caml_gc_trace_now ();
+  }
   Assert (caml_gc_phase == Phase_sweep);
   while (caml_gc_phase == Phase_sweep) sweep_slice (LONG_MAX);
+  CAML_GC_TRACE_END (trace_start, CAML_GC_TRACE_SWEEP,
+                     Wsize_bsize (caml_stat_heap_size));
   Assert (caml_gc_phase == Phase_idle);
   caml_stat_major_words += caml_allocated_words;
   caml_allocated_words = 0;
@@ -19,6 +19,7 @@
 #include "gc_ctrl.h"
 #include "major_gc.h"
 #include "memory.h"
+#include "memprof.h"
 #include "major_gc.h"
 #include "minor_gc.h"
 #include "misc.h"
@@ -432,6 +433,7 @@ CAMLexport value caml_alloc_shr (mlsize_t wosize, tag_t tag)
     Hd_hp (hp) = Make_header (wosize, tag, Caml_white);
   }
   Assert (Hd_hp (hp) == Make_header (wosize, tag, caml_allocation_color (hp)));
+  if (caml_memprof_running) caml_memprof_sample_major (Val_hp (hp), wosize);
   caml_allocated_words += Whsize_wosize (wosize);
   if (caml_allocated_words > Wsize_bsize (caml_minor_heap_size)){
     caml_urge_major_slice ();
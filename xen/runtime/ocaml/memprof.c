@@ -0,0 +1,459 @@
+/*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Statistical allocation profiler, see memprof.h. */
+
+#include <math.h>
+#include <string.h>
+#include "alloc.h"
+#include "bigarray.h"
+#include "fail.h"
+#include "gc.h"
+#include "major_gc.h"
+#include "memory.h"
+#include "memprof.h"
+#include "minor_gc.h"
+#include "misc.h"
+#include "mlvalues.h"
+#include "stack.h"
+
+extern frame_descr * caml_next_frame_descriptor(uintnat * pc, char ** sp);
+
+/* Frames recorded per call stack. */
+#define Memprof_depth 16
+
+/* Number of distinct call stacks (a power of 2). The samples of the
+   call stacks that do not fit are counted in an extra, empty one. */
+#define Memprof_sites 1024
+
+/* Number of sampled blocks that are followed at the same time. */
+#define Memprof_tracked 4096
+
+struct site {
+  uintnat samples;      /* sampled words */
+  uintnat major;        /* ... allocated directly in the major heap */
+  uintnat promoted;     /* ... that survived a minor collection */
+  uintnat survived;     /* ... that survived a major collection */
+  uintnat live;         /* ... that are still followed and alive */
+  uintnat hash;
+  int depth;            /* -1 for an unused entry */
+  frame_descr *frames[Memprof_depth];
+};
+
+#define Tracked_young 1
+#define Tracked_survived 2
+
+struct tracked {
+  value v;
+  uintnat site;
+  uintnat weight;
+  int flags;
+};
+
+int caml_memprof_running = 0;
+
+static double rate = 0.0;          /* samples per word */
+static struct site *sites = NULL;  /* [Memprof_sites + 1] entries */
+static struct tracked *tracked = NULL;
+static uintnat n_tracked = 0;
+static uintnat untracked = 0;      /* samples that could not be followed */
+
+static char *trigger = NULL;       /* minor heap trap, or NULL */
+static char *trap_ptr = NULL;      /* set between the two trap entries */
+static intnat trap_site;
+static uintnat major_countdown;    /* words until the next major sample */
+
+static uint64 rand_state = 0x2545F4914F6CDD1DULL;
+
+/* Number of words up to and including the next sampled one. The gaps
+   between samples are exponentially distributed, so a new gap can be
+   drawn at any time without biasing the samples. */
+static uintnat draw (void)
+{
+  double u, d;
+
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 7;
+  rand_state ^= rand_state << 17;
+  u = ((double) (rand_state >> 11) + 1.0) * (1.0 / 9007199254740992.0);
+  d = ceil (- log (u) / rate);
+  if (d < 1.0) return 1;
+  if (d > (double) (Max_long / sizeof (value))){
+    return Max_long / sizeof (value);
+  }
+  return (uintnat) d;
+}
+
+static intnat find_site (void)
+{
+  frame_descr *frames[Memprof_depth];
+  uintnat pc = caml_last_return_address, h = 0, i, n;
+  char *sp = caml_bottom_of_stack;
+  int depth = 0;
+
+  while (sp != NULL && depth < Memprof_depth){
+    frame_descr *d = caml_next_frame_descriptor (&pc, &sp);
+    if (d == NULL) break;
+    frames[depth++] = d;
+    h = h * 65599 + ((uintnat) d >> 3);
+#ifndef Stack_grows_upwards
+    if (sp > caml_top_of_stack) break;
+#else
+    if (sp < caml_top_of_stack) break;
+#endif
+  }
+  for (n = 0, i = h; n < Memprof_sites; n++, i++){
+    struct site *s = &sites[i & (Memprof_sites - 1)];
+    if (s->depth < 0){
+      s->depth = depth;
+      s->hash = h;
+      memcpy (s->frames, frames, depth * sizeof (frame_descr *));
+      return i & (Memprof_sites - 1);
+    }
+    if (s->hash == h && s->depth == depth
+        && memcmp (s->frames, frames, depth * sizeof (frame_descr *)) == 0){
+      return i & (Memprof_sites - 1);
+    }
+  }
+  return Memprof_sites;
+}
+
+static void track (value v, intnat site, uintnat weight, int flags)
+{
+  struct tracked *t;
+
+  sites[site].samples += weight;
+  sites[site].live += weight;
+  if (n_tracked == Memprof_tracked){
+    untracked += weight;
+    sites[site].live -= weight;
+    return;
+  }
+  t = &tracked[n_tracked++];
+  t->v = v;
+  t->site = site;
+  t->weight = weight;
+  t->flags = flags;
+}
+
+static void untrack (uintnat i)
+{
+  sites[tracked[i].site].live -= tracked[i].weight;
+  tracked[i] = tracked[--n_tracked];
+}
+
+/* Set the minor heap trap so that the allocation that reaches the
+   next sampled word below [from] calls [caml_garbage_collection]. */
+static void arm (char *from)
+{
+  uintnat gap = Bsize_wsize (draw () - 1);
+
+  if ((uintnat) (from - caml_young_start) < gap){
+    trigger = NULL;   /* beyond this minor heap: drawn again after it */
+  }else{
+    trigger = from - gap;
+    if (trigger > caml_young_limit) caml_young_limit = trigger;
+  }
+}
+
+void caml_memprof_renew_minor_sample (void)
+{
+  if (caml_memprof_running && trap_ptr == NULL) arm (caml_young_ptr);
+}
+
+/* The allocation that crossed the trigger has already moved
+   [caml_young_ptr] down by its size, but we do not know that size, nor
+   where the block will be. So the first entry raises the limit to the
+   current pointer and returns: the retried allocation traps again, and
+   the difference between the two pointers is its size. */
+int caml_memprof_trap (asize_t *bytes, intnat *site)
+{
+  *bytes = 0;
+  *site = -1;
+  if (trap_ptr != NULL){
+    *bytes = trap_ptr - caml_young_ptr;
+    *site = trap_site;
+    trap_ptr = NULL;
+    return 0;
+  }
+  if (!caml_memprof_running || trigger == NULL
+      || caml_young_ptr < caml_young_start || caml_young_ptr >= trigger){
+    return 0;
+  }
+  trigger = NULL;
+  trap_site = find_site ();
+  trap_ptr = caml_young_ptr;
+  caml_young_limit = trap_ptr;
+  return 1;
+}
+
+/* The retried allocation will take the [bytes] just below
+   [caml_young_ptr]. There are no asynchronous signals on Xen, so
+   nothing else can allocate before it. */
+void caml_memprof_sample_young (asize_t bytes, intnat site)
+{
+  char *hp;
+
+  if (!caml_memprof_running) return;
+  if (bytes == 0){
+    arm (caml_young_ptr);
+    return;
+  }
+  hp = caml_young_ptr - bytes;
+  track (Val_hp (hp), site, 1, Tracked_young);
+  caml_young_limit = caml_young_start;
+  arm (hp);
+}
+
+/* Called by [Alloc_small] when a C allocation took the young pointer
+   below [caml_young_limit]. The block is complete and just at
+   [caml_young_ptr], so it is sampled on the spot. Nothing is collected
+   here: a pending collection is left to the next OCaml allocation,
+   which traps on the limit. */
+CAMLexport void caml_memprof_sample_c_young (void)
+{
+  if (!caml_memprof_running || trigger == NULL || trap_ptr != NULL
+      || caml_young_ptr >= trigger){
+    return;
+  }
+  track (Val_hp (caml_young_ptr), find_site (), 1, Tracked_young);
+  if (caml_young_limit == trigger) caml_young_limit = caml_young_start;
+  arm (caml_young_ptr);
+}
+
+void caml_memprof_sample_major (value v, mlsize_t wosize)
+{
+  uintnat whsize = Whsize_wosize (wosize), n = 0;
+
+  if (caml_in_minor_collection) return;   /* promotion, not allocation */
+  while (major_countdown <= whsize){
+    ++ n;
+    major_countdown += draw ();
+  }
+  major_countdown -= whsize;
+  if (n > 0){
+    intnat site = find_site ();
+    sites[site].major += n;
+    track (v, site, n, 0);
+  }
+}
+
+/* Called by the minor GC once all the live young blocks have been
+   promoted, and before the minor heap is reset. */
+void caml_memprof_minor_update (void)
+{
+  uintnat i = 0;
+
+  while (i < n_tracked){
+    struct tracked *t = &tracked[i];
+    if (t->flags & Tracked_young){
+      if (Hd_val (t->v) == 0){
+        /* Promoted: the first field is the forwarding pointer. */
+        t->v = Field (t->v, 0);
+        t->flags &= ~Tracked_young;
+        sites[t->site].promoted += t->weight;
+      }else{
+        untrack (i);
+        continue;
+      }
+    }
+    ++ i;
+  }
+}
+
+/* Called by the major GC at the end of the marking phase, when all
+   the blocks that are still white are dead. */
+void caml_memprof_major_update (void)
+{
+  uintnat i = 0;
+
+  while (i < n_tracked){
+    struct tracked *t = &tracked[i];
+    if (!(t->flags & Tracked_young)){
+      if (Is_white_val (t->v)){
+        untrack (i);
+        continue;
+      }
+      if (!(t->flags & Tracked_survived)){
+        t->flags |= Tracked_survived;
+        sites[t->site].survived += t->weight;
+      }
+    }
+    ++ i;
+  }
+}
+
+/* Let the compactor update the followed blocks. These are not roots:
+   all of them are alive when the compactor runs. */
+void caml_memprof_do_roots (scanning_action f)
+{
+  uintnat i;
+
+  for (i = 0; i < n_tracked; i++){
+    if (!(tracked[i].flags & Tracked_young)) f (tracked[i].v, &tracked[i].v);
+  }
+}
+
+void caml_memprof_do_samples (void (*f) (value, frame_descr **, int))
+{
+  uintnat i;
+
+  for (i = 0; i < n_tracked; i++){
+    if (!(tracked[i].flags & Tracked_young)){
+      struct site *s = &sites[tracked[i].site];
+      f (tracked[i].v, s->frames, s->depth);
+    }
+  }
+}
+
+static void reset (void)
+{
+  uintnat i;
+
+  for (i = 0; i <= Memprof_sites; i++){
+    memset (&sites[i], 0, sizeof (struct site));
+    sites[i].depth = -1;
+  }
+  sites[Memprof_sites].depth = 0;
+  n_tracked = 0;
+  untracked = 0;
+}
+
+CAMLprim value caml_memprof_start (value v_rate)
+{
+  double r = Double_val (v_rate);
+
+  if (!(r > 0.0 && r <= 1.0)) caml_invalid_argument ("Memprof.start");
+  if (sites == NULL){
+    sites = caml_stat_alloc ((Memprof_sites + 1) * sizeof (struct site));
+    tracked = caml_stat_alloc (Memprof_tracked * sizeof (struct tracked));
+    reset ();
+  }
+  rate = r;
+  caml_memprof_running = 1;
+  major_countdown = draw ();
+  if (trigger == NULL) arm (caml_young_ptr);
+  return Val_unit;
+}
+
+CAMLprim value caml_memprof_stop (value v)
+{
+  if (trigger != NULL && caml_young_limit == trigger){
+    caml_young_limit = caml_young_start;
+  }
+  trigger = NULL;
+  caml_memprof_running = 0;
+  return Val_unit;
+}
+
+CAMLprim value caml_memprof_reset (value v)
+{
+  if (sites != NULL) reset ();
+  return Val_unit;
+}
+
+CAMLprim value caml_memprof_status (value v)
+{
+  CAMLparam0 ();   /* v is ignored */
+  CAMLlocal2 (res, r);
+
+  r = caml_copy_double (rate);
+  res = caml_alloc_tuple (4);
+  Store_field (res, 0, Val_bool (caml_memprof_running));
+  Store_field (res, 1, r);
+  Store_field (res, 2, Val_long (n_tracked));
+  Store_field (res, 3, Val_long (untracked));
+  CAMLreturn (res);
+}
+
+/* The sites are read after each allocation below, because these can
+   add samples. Sites are never moved, so the indices stay valid. */
+CAMLprim value caml_memprof_sites (value v)
+{
+  CAMLparam0 ();   /* v is ignored */
+  CAMLlocal3 (res, site, trace);
+  uintnat i, n = 0, j;
+  int k;
+
+  if (sites != NULL){
+    for (i = 0; i <= Memprof_sites; i++) if (sites[i].samples > 0) ++ n;
+  }
+  res = caml_alloc_tuple (n);
+  for (i = 0, j = 0; j < n && i <= Memprof_sites; i++){
+    if (sites[i].samples == 0) continue;
+    trace = caml_alloc (sites[i].depth, Abstract_tag);
+    for (k = 0; k < sites[i].depth; k++){
+      Field (trace, k) = (value) sites[i].frames[k];
+    }
+    site = caml_alloc_tuple (6);
+    Store_field (site, 0, Val_long (sites[i].samples));
+    Store_field (site, 1, Val_long (sites[i].major));
+    Store_field (site, 2, Val_long (sites[i].promoted));
+    Store_field (site, 3, Val_long (sites[i].survived));
+    Store_field (site, 4, Val_long (sites[i].live));
+    Store_field (site, 5, trace);
+    Store_field (res, j++, site);
+  }
+  CAMLreturn (res);
+}
+
+/* Binary profile, in host byte order:
+     "MPRF", u32 version (1), f64 rate, u32 number of sites, u32 0
+   then for each site:
+     u32 samples, major, promoted, survived, live, depth,
+     u64 return address * depth
+   The return addresses can be resolved against the unikernel image. */
+
+#define Put32(p, x) do{ uint32 _x = (uint32) (x); \
+    memcpy ((p), &_x, 4); (p) += 4; }while(0)
+#define Put64(p, x) do{ uint64 _x = (uint64) (x); \
+    memcpy ((p), &_x, 8); (p) += 8; }while(0)
+
+CAMLprim value caml_memprof_write (value v_buf, value v_ofs, value v_len)
+{
+  intnat o = Long_val (v_ofs), l = Long_val (v_len);
+  char *start, *p, *end;
+  uintnat i, n = 0;
+  int k;
+
+  if (o < 0 || l < 0 || o + l > Caml_ba_array_val (v_buf)->dim[0]){
+    caml_invalid_argument ("Memprof.write");
+  }
+  start = p = (char *) Caml_ba_data_val (v_buf) + o;
+  end = start + l;
+  if (l < 24) return Val_long (-1);
+  if (sites != NULL){
+    for (i = 0; i <= Memprof_sites; i++) if (sites[i].samples > 0) ++ n;
+  }
+  memcpy (p, "MPRF", 4); p += 4;
+  Put32 (p, 1);
+  memcpy (p, &rate, 8); p += 8;
+  Put32 (p, n);
+  Put32 (p, 0);
+  for (i = 0; n > 0 && i <= Memprof_sites; i++){
+    struct site *s = &sites[i];
+    if (s->samples == 0) continue;
+    if (end - p < 24 + 8 * s->depth) return Val_long (-1);
+    Put32 (p, s->samples);
+    Put32 (p, s->major);
+    Put32 (p, s->promoted);
+    Put32 (p, s->survived);
+    Put32 (p, s->live);
+    Put32 (p, s->depth);
+    for (k = 0; k < s->depth; k++) Put64 (p, s->frames[k]->retaddr);
+  }
+  return Val_long (p - start);
+}
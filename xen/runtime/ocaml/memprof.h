@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef CAML_MEMPROF_H
+#define CAML_MEMPROF_H
+
+#include "config.h"
+#include "misc.h"
+#include "mlvalues.h"
+#include "roots.h"
+#include "stack.h"
+
+/* Statistical allocation profiler.
+
+   Allocated words are sampled at random with a fixed rate, and the
+   call stack of each sampled allocation is recorded. Minor allocations
+   from OCaml code are caught by raising [caml_young_limit] to the next
+   sampled word, so that the allocation traps into
+   [caml_garbage_collection]; minor allocations from C check the same
+   limit in [Alloc_small] and call [caml_memprof_sample_c_young], and
+   neither path collects because of it. Major allocations are counted
+   in [caml_alloc_shr]. The sampled blocks are then followed, without
+   keeping them alive, to see whether they are promoted and whether
+   they survive major collections. */
+
+extern int caml_memprof_running;
+
+/* Called by [caml_garbage_collection] on entry. A non-zero result
+   means that the entry only served to measure a sampled allocation,
+   which must be retried at once. Otherwise [*bytes] and [*site] are
+   filled in when the allocation being retried is a sampled one, and
+   must be passed to [caml_memprof_sample_young] once the collection,
+   if any, is done. */
+extern int caml_memprof_trap (asize_t *bytes, intnat *site);
+extern void caml_memprof_sample_young (asize_t bytes, intnat site);
+
+/* Re-arm the minor heap trap after [caml_young_limit] was reset. */
+extern void caml_memprof_renew_minor_sample (void);
+
+extern void caml_memprof_sample_major (value v, mlsize_t wosize);
+extern void caml_memprof_minor_update (void);
+extern void caml_memprof_major_update (void);
+extern void caml_memprof_do_roots (scanning_action f);
+
+/* Call [f] on each followed block of the major heap, with the call
+   stack of its allocation. */
+extern void caml_memprof_do_samples (void (*f) (value, frame_descr **, int));
+
+#endif /* CAML_MEMPROF_H */
@@ -17,8 +17,10 @@
 #include "finalise.h"
 #include "gc.h"
 #include "gc_ctrl.h"
+#include "gc_trace.h"
 #include "major_gc.h"
 #include "memory.h"
+#include "memprof.h"
 #include "minor_gc.h"
 #include "misc.h"
 #include "mlvalues.h"
@@ -71,21 +73,21 @@ static void clear_table (struct caml_ref_table *tbl)
     tbl->limit = tbl->threshold;
 }
 
-/* size in bytes */
-void caml_set_minor_heap_size (asize_t size)
+/* Replace the (empty) minor heap with one of [size] bytes.
+   Return 0 on success, or -1 if the new heap cannot be allocated, in
+   which case the current one is left in place. */
+static int resize_minor_heap (asize_t size)
 {
   char *new_heap;
   void *new_heap_base;
 
-  Assert (size >= Bsize_wsize(Minor_heap_min));
-  Assert (size <= Bsize_wsize(Minor_heap_max));
-  Assert (size % sizeof (value) == 0);
-  if (caml_young_ptr != caml_young_end) caml_minor_collection ();
                                     Assert (caml_young_ptr == caml_young_end);
   new_heap = caml_aligned_malloc(size, 0, &new_heap_base);
-  if (new_heap == NULL) caml_raise_out_of_memory();
-  if (caml_page_table_add(In_young, new_heap, new_heap + size) != 0)
-    caml_raise_out_of_memory();
+  if (new_heap == NULL) return -1;
+  if (caml_page_table_add(In_young, new_heap, new_heap + size) != 0){
+    free (new_heap_base);
+    return -1;
+  }
 
   if (caml_young_start != NULL){
     caml_page_table_remove(In_young, caml_young_start, caml_young_end);
@@ -97,9 +99,22 @@ void caml_set_minor_heap_size (asize_t size)
   caml_young_limit = caml_young_start;
   caml_young_ptr = caml_young_end;
   caml_minor_heap_size = size;
+  caml_memprof_renew_minor_sample ();
 
   reset_table (&caml_ref_table);
   reset_table (&caml_weak_ref_table);
+  return 0;
+}
+
+/* size in bytes */
+void caml_set_minor_heap_size (asize_t size)
+{
+  Assert (size >= Bsize_wsize(Minor_heap_min));
+  Assert (size <= Bsize_wsize(Minor_heap_max));
+  Assert (size % sizeof (value) == 0);
+  if (caml_young_ptr != caml_young_end) caml_minor_collection ();
+                                    Assert (caml_young_ptr == caml_young_end);
+  if (resize_minor_heap (size) != 0) caml_raise_out_of_memory();
 }
 
 static value oldify_todo_list = 0;
@@ -228,6 +243,8 @@ void caml_empty_minor_heap (void)
   value **r;
 
   if (caml_young_ptr != caml_young_end){
+    CAML_GC_TRACE_BEGIN (trace_start);
+
     caml_in_minor_collection = 1;
     caml_gc_message (0x02, "<", 0);
     caml_oldify_local_roots();
@@ -235,6 +252,7 @@ void caml_empty_minor_heap (void)
       caml_oldify_one (**r, *r);
     }
     caml_oldify_mopup ();
+    caml_memprof_minor_update ();
     for (r = caml_weak_ref_table.base; r < caml_weak_ref_table.ptr; r++){
       if (Is_block (**r) && Is_young (**r)){
         if (Hd_val (**r) == 0){
@@ -248,10 +266,13 @@ void caml_empty_minor_heap (void)
     caml_stat_minor_words += Wsize_bsize (caml_young_end - caml_young_ptr);
     caml_young_ptr = caml_young_end;
     caml_young_limit = caml_young_start;
+    caml_memprof_renew_minor_sample ();
     clear_table (&caml_ref_table);
     clear_table (&caml_weak_ref_table);
     caml_gc_message (0x02, ">", 0);
     caml_in_minor_collection = 0;
+    CAML_GC_TRACE_END (trace_start, CAML_GC_TRACE_MINOR,
+                       Wsize_bsize (caml_minor_heap_size));
   }
   caml_final_empty_young ();
 #ifdef DEBUG
@@ -269,13 +290,102 @@ void caml_empty_minor_heap (void)
    functions, etc.
    Leave the minor heap empty.
 */
+/* Adaptive sizing of the minor heap.
+   Every [Minor_adapt_window] minor collections, we look at the fraction
+   of the minor words that survived and at the average time between two
+   collections.  A high survival rate means that the values are promoted
+   before they have had time to die: double the minor heap.  So does a
+   high collection frequency, because the roots are scanned at every
+   collection.  When almost nothing survives and the collections are
+   not frequent, halve the minor heap to give back the memory and keep
+   it warm in the cache.  The size always stays within
+   [caml_minor_heap_wsz_min .. caml_minor_heap_wsz_max] (words).
+   An explicit size always wins: adaptation is turned off when
+   OCAMLRUNPARAM gives the size (see startup.c) and when [Gc.set]
+   changes it. */
+
+#define Minor_adapt_window 8
+#define Minor_adapt_grow_survival 0.10   /* grow above 10% survival */
+#define Minor_adapt_shrink_survival 0.01 /* shrink below 1% survival */
+#define Minor_adapt_min_interval 200.0   /* microseconds */
+
+int caml_minor_heap_adaptive = 1;
+uintnat caml_minor_heap_wsz_min = Minor_heap_def;
+uintnat caml_minor_heap_wsz_max = 4 * Minor_heap_def;
+struct caml_minor_heap_stats caml_minor_heap_stats = { 0, 0, 0.0 };
+
+static struct {
+  int collections;
+  double minor_words;
+  double promoted_words;
+  double start;
+} adapt = { 0, 0.0, 0.0, -1.0 };
+
+/* Microseconds on the monotonic clock of the GC trace, which the wall
+   clock could step. */
+static double minor_now (void)
+{
+  return (double) caml_gc_trace_now () / 1000.0;
+}
+
+void caml_minor_heap_reset_adapt (void)
+{
+  adapt.collections = 0;
+  adapt.minor_words = adapt.promoted_words = 0.0;
+  adapt.start = minor_now ();
+}
+
+/* Called with an empty minor heap at the end of a minor collection. */
+static void adapt_minor_heap (double minor_words, double promoted_words)
+{
+  uintnat wsz = Wsize_bsize (caml_minor_heap_size), new_wsz = wsz;
+  double survival, interval, now;
+
+  if (!caml_minor_heap_adaptive) return;
+  adapt.minor_words += minor_words;
+  adapt.promoted_words += promoted_words;
+  if (++ adapt.collections < Minor_adapt_window) return;
+
+  survival = adapt.minor_words > 0.0
+             ? adapt.promoted_words / adapt.minor_words : 0.0;
+  caml_minor_heap_stats.survival = survival;
+  now = minor_now ();
+  interval = (now >= 0.0 && adapt.start >= 0.0)
+             ? (now - adapt.start) / adapt.collections : -1.0;
+
+  if (survival > Minor_adapt_grow_survival
+      || (interval >= 0.0 && interval < Minor_adapt_min_interval)){
+    if (wsz < caml_minor_heap_wsz_max){
+      new_wsz = 2 * wsz;
+      if (new_wsz > caml_minor_heap_wsz_max) new_wsz = caml_minor_heap_wsz_max;
+    }
+  }else if (survival < Minor_adapt_shrink_survival
+            && (interval < 0.0 || interval > 4 * Minor_adapt_min_interval)){
+    if (wsz > caml_minor_heap_wsz_min){
+      new_wsz = wsz / 2;
+      if (new_wsz < caml_minor_heap_wsz_min) new_wsz = caml_minor_heap_wsz_min;
+    }
+  }
+  if (new_wsz != wsz
+      && resize_minor_heap (Bsize_wsize (new_wsz)) == 0){
+    if (new_wsz > wsz) ++ caml_minor_heap_stats.grows;
+    else ++ caml_minor_heap_stats.shrinks;
+    caml_gc_message (0x08, "Minor heap resized to %luk words\n",
+                     (uintnat) new_wsz / 1024);
+  }
+  caml_minor_heap_reset_adapt ();
+}
+
 CAMLexport void caml_minor_collection (void)
 {
   intnat prev_alloc_words = caml_allocated_words;
+  double prev_minor_words = caml_stat_minor_words;
+  intnat promoted;
 
   caml_empty_minor_heap ();
 
-  caml_stat_promoted_words += caml_allocated_words - prev_alloc_words;
+  promoted = caml_allocated_words - prev_alloc_words;
+  caml_stat_promoted_words += promoted;
   ++ caml_stat_minor_collections;
   caml_major_collection_slice (0);
   caml_force_major_slice = 0;
@@ -283,6 +393,9 @@ CAMLexport void caml_minor_collection (void)
   caml_final_do_calls ();
 
   caml_empty_minor_heap ();
+
+  adapt_minor_heap (caml_stat_minor_words - prev_minor_words,
+                    (double) promoted);
 }
 
 CAMLexport value caml_check_urgent_gc (value extra_root)
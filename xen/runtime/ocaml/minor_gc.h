@@ -38,6 +38,17 @@ CAMLextern struct caml_ref_table caml_ref_table, caml_weak_ref_table;
    (addr)(val) < (addr)caml_young_end && (addr)(val) > (addr)caml_young_start)
 
 extern void caml_set_minor_heap_size (asize_t); /* size in bytes */
+
+/* Adaptive sizing of the minor heap, see minor_gc.c. Bounds in words. */
+struct caml_minor_heap_stats {
+  uintnat grows;
+  uintnat shrinks;
+  double survival;        /* over the last measurement window */
+};
+extern int caml_minor_heap_adaptive;
+extern uintnat caml_minor_heap_wsz_min, caml_minor_heap_wsz_max;
+extern struct caml_minor_heap_stats caml_minor_heap_stats;
+extern void caml_minor_heap_reset_adapt (void);
 extern void caml_empty_minor_heap (void);
 CAMLextern void caml_minor_collection (void);
 CAMLextern void garbage_collection (void); /* def in asmrun/signals.c */
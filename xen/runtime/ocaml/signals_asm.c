@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include "fail.h"
 #include "memory.h"
+#include "memprof.h"
 #include "osdeps.h"
 #include "signals.h"
 #include "signals_machdep.h"
@@ -65,10 +66,15 @@ extern char caml_system__code_begin, caml_system__code_end;
 
 void caml_garbage_collection(void)
 {
+  asize_t sampled;
+  intnat site;
+
+  if (caml_memprof_trap(&sampled, &site)) return;
   caml_young_limit = caml_young_start;
   if (caml_young_ptr < caml_young_start || caml_force_major_slice) {
     caml_minor_collection();
   }
+  caml_memprof_sample_young(sampled, site);
   caml_process_pending_signals();
 }
 
@@ -124,7 +124,10 @@ static void parse_camlrunparam(void)
   if (opt != NULL){
     while (*opt != '\0'){
       switch (*opt++){
-      case 's': scanmult (opt, &minor_heap_init); break;
+      case 's':
+        scanmult (opt, &minor_heap_init);
+        caml_minor_heap_adaptive = 0;   /* an explicit size wins */
+        break;
       case 'i': scanmult (opt, &heap_chunk_init); break;
       case 'h': scanmult (opt, &heap_size_init); break;
       case 'l': scanmult (opt, &max_stack_init); break;
@@ -30,6 +30,11 @@
 
 extern grant_entry_t *gnttab_table;
 
+/* Pages currently mapped from other domains, and granted to them.
+   Read by caml_memory_report. */
+unsigned long gnttab_mapped_pages = 0;
+unsigned long gntshr_granted_pages = 0;
+
 CAMLprim value stub_gnttab_interface_open(value unit)
 {
 	CAMLparam1(unit);
@@ -68,6 +73,7 @@ stub_gnttab_unmap(value i, value v_handle)
     printk("GNTTABOP_unmap_grant_ref handle = %x failed", op.handle);
     caml_failwith("Failed to unmap grant.");
   }
+  gnttab_mapped_pages--;
 
   CAMLreturn(Val_unit);
 }
@@ -100,6 +106,7 @@ stub_gnttab_map_onto(value i, value v_ref, value v_iopage, value v_domid, value
       caml_failwith("caml_gnttab_map");
     }
 
+    gnttab_mapped_pages++;
     printk("GNTTABOP_map_grant_ref mapped to %x\n", op.host_addr);
     CAMLreturn(Val_int(op.handle));
 }
@@ -168,6 +175,8 @@ CAMLprim value stub_gntshr_close(value unit)
 static void
 gntshr_grant_access(grant_ref_t ref, void *page, int domid, int ro)
 {
+    if (!(gnttab_table[ref].flags & GTF_permit_access))
+        gntshr_granted_pages++;
     gnttab_table[ref].frame = virt_to_mfn(page);
     gnttab_table[ref].domid = domid;
     wmb();
@@ -200,6 +209,8 @@ stub_gntshr_end_access(value v_ref)
         }
     } while ((nflags = synch_cmpxchg(&gnttab_table[ref].flags, flags, 0)) !=
             flags);
+    if (flags & GTF_permit_access)
+        gntshr_granted_pages--;
 
     return Val_unit;
 }
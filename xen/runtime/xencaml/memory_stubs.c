@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Breakdown of the memory of the domain, from the counters kept by the
+   OCaml runtime and the stubs. Every figure is read directly, so a
+   report is cheap enough to be taken periodically. */
+
+#include <mini-os/os.h>
+#include <mini-os/mm.h>
+
+#include <caml/mlvalues.h>
+#include <caml/memory.h>
+#include <caml/alloc.h>
+#include <caml/bigarray.h>
+#include <caml/freelist.h>
+#include <caml/gc_ctrl.h>
+#include <caml/minor_gc.h>
+
+
+extern unsigned long gnttab_mapped_pages;
+extern unsigned long gntshr_granted_pages;
+
+CAMLprim value
+caml_memory_report(value unit)
+{
+  CAMLparam1(unit);
+  CAMLlocal1(result);
+  uintnat total = (uintnat)start_info.nr_pages * PAGE_SIZE;
+  /* Mini-os runs us on its boot stack, which is 2 * STACK_SIZE of its
+     bss; no other thread is created. */
+  uintnat stack_bytes = 2 * STACK_SIZE;
+  /* The domain builder lays out the kernel image, the boot modules,
+     the P2M table, the start info page and the page tables before the
+     first page that mini-os hands to its allocator. */
+  uintnat kernel = to_phys(start_info.pt_base)
+                   + start_info.nr_pt_frames * PAGE_SIZE - stack_bytes;
+  uintnat major = caml_stat_heap_size;
+  uintnat minor = caml_minor_heap_size;
+  uintnat known = kernel + stack_bytes + major + minor
+                  + caml_ba_io_page_bytes + caml_ba_managed_bytes;
+
+  result = caml_alloc_tuple(11);
+  Store_field(result, 0, Val_long(total));
+  Store_field(result, 1, Val_long(kernel));
+  Store_field(result, 2, Val_long(stack_bytes));
+  Store_field(result, 3, Val_long(major));
+  Store_field(result, 4, Val_long(caml_fl_cur_size * sizeof(value)));
+  Store_field(result, 5, Val_long(minor));
+  Store_field(result, 6, Val_long(caml_ba_io_page_bytes));
+  Store_field(result, 7, Val_long(gntshr_granted_pages * PAGE_SIZE));
+  Store_field(result, 8, Val_long(gnttab_mapped_pages * PAGE_SIZE));
+  Store_field(result, 9, Val_long(caml_ba_managed_bytes));
+  Store_field(result, 10, Val_long(total > known ? total - known : 0));
+  CAMLreturn(result);
+}
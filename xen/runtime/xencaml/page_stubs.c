@@ -23,27 +23,116 @@
 #include <caml/alloc.h>
 #include <caml/fail.h>
 #include <caml/bigarray.h>
+#include <caml/minor_gc.h>
+
+extern void caml_finish_major_cycle(void);
+
+/* Live I/O pages are not in the OCaml heap, so the GC cannot see how
+   much memory they pin down. We count them (in caml_ba_io_page_bytes,
+   maintained with the bigarray finaliser) against a budget that is a
+   fraction of the domain memory, and make the GC work harder as they
+   use it up. When they go over it, a full major cycle is run to
+   finalise the unreachable ones before allocating more. */
+
+#define IO_PAGE_DEFAULT_BUDGET_PERCENT 50
+
+static uintnat io_page_budget = 0;       /* bytes; 0 until first use */
+static uintnat io_page_forced_at = 0;    /* live bytes after the last
+                                            forced collection */
+static uintnat io_page_forced_collections = 0;
+static uintnat io_page_failed_allocations = 0;
+
+static uintnat
+io_page_get_budget(void)
+{
+  if (io_page_budget == 0)
+    io_page_budget = (uintnat)start_info.nr_pages * PAGE_SIZE
+                     / 100 * IO_PAGE_DEFAULT_BUDGET_PERCENT;
+  return io_page_budget;
+}
+
+static void
+io_page_collect(void)
+{
+  caml_minor_collection();
+  caml_finish_major_cycle();
+  io_page_forced_collections++;
+  io_page_forced_at = caml_ba_io_page_bytes;
+}
 
 /* Allocate a page-aligned bigarray of length [n_pages] pages.
    Since CAML_BA_MANAGED is set the bigarray C finaliser will
    call free() whenever all sub-bigarrays are unreachable.
+   The bigarray is allocated first, as an external one with no data,
+   since that allocation can raise Out_of_memory: only then is the block
+   allocated, attached to it and counted, so that neither leaks.
  */
+static char io_page_no_data;
+
 CAMLprim value
 caml_alloc_pages(value n_pages)
 {
   CAMLparam1(n_pages);
+  CAMLlocal1(result);
   size_t len = Int_val(n_pages) * PAGE_SIZE;
-  /* If the allocation fails, return None. The ocaml layer will
-     be able to trigger a full GC which just might run finalizers
-     of unused bigarrays which will free some memory. */
-  void* block = _xmalloc(len, PAGE_SIZE);
+  uintnat budget = io_page_get_budget();
+  struct caml_ba_array *b;
+  void* block;
+
+  /* Over budget: collect before allocating, unless nothing much was
+     allocated since the last time this did not help. */
+  if (caml_ba_io_page_bytes + len > budget
+      && caml_ba_io_page_bytes > io_page_forced_at + budget / 16)
+    io_page_collect();
+
+  result = caml_ba_alloc_dims(CAML_BA_UINT8 | CAML_BA_C_LAYOUT | CAML_BA_EXTERNAL, 1, &io_page_no_data, len);
 
+  block = _xmalloc(len, PAGE_SIZE);
   if (block == NULL) {
+    /* A full GC just might run the finalisers of unused bigarrays,
+       which will free some memory. */
+    io_page_collect();
+    block = _xmalloc(len, PAGE_SIZE);
+  }
+  if (block == NULL) {
+    io_page_failed_allocations++;
     printk("memalign(%d, %d) failed.\n", PAGE_SIZE, len);
     caml_failwith("memalign");
   }
   /* Explicitly zero the page before returning it */
   memset(block, 0, len);
 
-  CAMLreturn(caml_ba_alloc_dims(CAML_BA_UINT8 | CAML_BA_C_LAYOUT | CAML_BA_MANAGED, 1, block, len));
+  b = Caml_ba_array_val(result);
+  b->data = block;
+  b->flags |= CAML_BA_MANAGED | CAML_BA_IO_PAGE;
+  caml_ba_io_page_bytes += len;
+  /* Allocating the whole budget is worth a full major cycle. */
+  caml_adjust_gc_speed(len, budget);
+
+  CAMLreturn(result);
+}
+
+CAMLprim value
+caml_io_page_stats(value unit)
+{
+  CAMLparam1(unit);
+  CAMLlocal1(result);
+
+  result = caml_alloc_tuple(5);
+  Store_field(result, 0, Val_long(caml_ba_io_page_bytes));
+  Store_field(result, 1, Val_long(io_page_get_budget()));
+  Store_field(result, 2, Val_long((uintnat)start_info.nr_pages * PAGE_SIZE));
+  Store_field(result, 3, Val_long(io_page_forced_collections));
+  Store_field(result, 4, Val_long(io_page_failed_allocations));
+  CAMLreturn(result);
+}
+
+CAMLprim value
+caml_io_page_set_budget(value v_bytes)
+{
+  intnat bytes = Long_val(v_bytes);
+  if (bytes <= 0)
+    caml_invalid_argument("Memory.set_io_page_budget");
+  io_page_budget = bytes;
+  return Val_unit;
 }
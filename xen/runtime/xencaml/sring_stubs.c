@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2014 Citrix Systems Inc
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Producer/consumer index handling for the standard Xen shared ring
+   layout (xen/io/ring.h), including the req_event/rsp_event
+   notification suppression protocol. The ring slots themselves are
+   read and written from OCaml; these stubs only move the shared
+   indices, so a caller can fill or drain N slots and pay for a single
+   barrier and at most one notification. */
+
+#include <stdint.h>
+#include <mini-os/os.h>
+
+#include <caml/mlvalues.h>
+#include <caml/bigarray.h>
+
+typedef uint32_t RING_IDX;
+
+/* The header at the start of every shared ring page. It is followed by
+   48 bytes of private/padding space and then the slots themselves. */
+struct sring_hdr {
+  RING_IDX req_prod, req_event;
+  RING_IDX rsp_prod, rsp_event;
+};
+
+#define Sring_val(v_buf, v_ofs) \
+  ((volatile struct sring_hdr *)((char *)Caml_ba_data_val(v_buf) + Long_val(v_ofs)))
+
+/* Publish a new producer index, and decide whether the other end
+   asked to be woken up for any of the entries between the old and
+   the new index (RING_PUSH_*_AND_CHECK_NOTIFY). */
+static inline int
+push_and_check_notify(volatile RING_IDX *prod, volatile RING_IDX *event, RING_IDX new)
+{
+  RING_IDX old = *prod;
+  wmb(); /* slots must be visible before the index */
+  *prod = new;
+  mb();  /* index must be visible before we look at the event */
+  return ((RING_IDX)(new - *event) < (RING_IDX)(new - old));
+}
+
+/* Re-arm the event index and check again for entries that arrived in
+   the meantime (RING_FINAL_CHECK_FOR_*). A false result means that the
+   other end is guaranteed to notify us about the next entry, so it is
+   safe to go to sleep. */
+static inline int
+final_check(volatile RING_IDX *prod, volatile RING_IDX *event, RING_IDX cons)
+{
+  if (*prod != cons)
+    return 1;
+  *event = cons + 1;
+  mb();
+  return (*prod != cons);
+}
+
+CAMLprim value
+stub_sring_push_requests(value v_buf, value v_ofs, value v_req_prod)
+{
+  volatile struct sring_hdr *s = Sring_val(v_buf, v_ofs);
+  return Val_bool(push_and_check_notify(&s->req_prod, &s->req_event,
+                                        (RING_IDX)Long_val(v_req_prod)));
+}
+
+CAMLprim value
+stub_sring_push_responses(value v_buf, value v_ofs, value v_rsp_prod)
+{
+  volatile struct sring_hdr *s = Sring_val(v_buf, v_ofs);
+  return Val_bool(push_and_check_notify(&s->rsp_prod, &s->rsp_event,
+                                        (RING_IDX)Long_val(v_rsp_prod)));
+}
+
+CAMLprim value
+stub_sring_final_check_for_requests(value v_buf, value v_ofs, value v_req_cons)
+{
+  volatile struct sring_hdr *s = Sring_val(v_buf, v_ofs);
+  return Val_bool(final_check(&s->req_prod, &s->req_event,
+                              (RING_IDX)Long_val(v_req_cons)));
+}
+
+CAMLprim value
+stub_sring_final_check_for_responses(value v_buf, value v_ofs, value v_rsp_cons)
+{
+  volatile struct sring_hdr *s = Sring_val(v_buf, v_ofs);
+  return Val_bool(final_check(&s->rsp_prod, &s->rsp_event,
+                              (RING_IDX)Long_val(v_rsp_cons)));
+}
+
+/* Snapshot a producer index. The read barrier orders it before any
+   subsequent slot reads, so the caller can consume every slot up to the
+   returned index without further barriers. */
+
+CAMLprim value
+stub_sring_req_prod(value v_buf, value v_ofs)
+{
+  volatile struct sring_hdr *s = Sring_val(v_buf, v_ofs);
+  RING_IDX prod = s->req_prod;
+  rmb();
+  return Val_long(prod);
+}
+
+CAMLprim value
+stub_sring_rsp_prod(value v_buf, value v_ofs)
+{
+  volatile struct sring_hdr *s = Sring_val(v_buf, v_ofs);
+  RING_IDX prod = s->rsp_prod;
+  rmb();
+  return Val_long(prod);
+}
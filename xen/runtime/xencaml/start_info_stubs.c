@@ -24,6 +24,7 @@
 
 #include <xen/xen.h>
 #include <mini-os/os.h>
+#include <mini-os/mm.h>
 
 CAMLprim value
 stub_start_info_get(value unit)
@@ -78,3 +79,49 @@ caml_xenstore_start_page(value v_unit)
                                 mfn_to_virt(start_info.store_mfn),
                                 (long)PAGE_SIZE));
 }
+
+/* Remap the pages of the boot module read-only, so that a stray write
+   through a view of it faults instead of corrupting it. */
+static void
+protect_boot_module(unsigned long start, unsigned long len)
+{
+  unsigned long va;
+
+  for (va = start & PAGE_MASK; va < start + len; va += PAGE_SIZE) {
+    pte_t pte = __pte((virt_to_mfn(va) << PAGE_SHIFT) | L1_PROT_RO);
+    if (HYPERVISOR_update_va_mapping(va, pte, UVMF_INVLPG) != 0) {
+      printk("boot module: failed to protect page %lx\n", va);
+      return;
+    }
+  }
+}
+
+/* The module loaded by the domain builder next to the kernel (the
+   ramdisk), in place. Its pages stay reserved for the whole life of
+   the domain, so the bigarray does not manage them. They are made
+   read-only on first use. */
+CAMLprim value
+caml_boot_module(value v_unit)
+{
+  CAMLparam1(v_unit);
+  CAMLlocal2(result, ba);
+  static int protected = 0;
+  unsigned long start = start_info.mod_start;
+
+  result = Val_int(0); /* None */
+  if (start != 0 && start_info.mod_len != 0) {
+#ifdef SIF_MOD_START_PFN
+    if (start_info.flags & SIF_MOD_START_PFN)
+      start = (unsigned long)pfn_to_virt(start);
+#endif
+    if (!protected) {
+      protect_boot_module(start, start_info.mod_len);
+      protected = 1;
+    }
+    ba = caml_ba_alloc_dims(CAML_BA_UINT8 | CAML_BA_C_LAYOUT, 1,
+                            (void *)start, (long)start_info.mod_len);
+    result = caml_alloc_small(1, 0);
+    Field(result, 0) = ba;
+  }
+  CAMLreturn(result);
+}